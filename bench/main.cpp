@@ -0,0 +1,437 @@
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include <algorithm>
+#include <sys/resource.h>
+
+extern "C"
+{
+#include <libavutil/pixdesc.h>
+}
+
+#include "MediaSource.h"
+#include "VideoReader.h"
+#include "AudioReader.h"
+#include "AudioOutput.h"
+#include "Telemetry.h"
+
+// Headless pipeline benchmark: demuxes, decodes and converts as fast as the
+// readers go, with frames released as soon as they are queued and audio pulled
+// through a device-less AudioOutput. Results go to stdout as one JSON object.
+
+enum SeekPattern
+{
+  SeekNone = 0,     // play the file through once
+  SeekRandom,       // uniformly random targets
+  SeekScrub,        // evenly spaced targets, front to back
+};
+
+static void PrintUsage()
+{
+  std::cout << "Usage: video-bench [--threads N|auto] [--thread-type frame|slice|auto] [--frame-queue N]\n"
+               "                   [--pix-fmt native|NAME] [--staging] [--no-audio] [--read-ahead on|off|auto]\n"
+               "                   [--seek none|random|scrub] [--seeks N] [--frames-per-seek N] [--seed N]\n"
+               "                   [--max-frames N] [--max-seconds S] [--label TEXT] [--trace FILE] <file>\n";
+}
+
+static std::string JsonString(const std::string& text)
+{
+  std::string quoted = "\"";
+  for (char c : text)
+  {
+    if (c == '"' || c == '\\')
+    {
+      quoted += '\\';
+      quoted += c;
+    }
+    else if ((unsigned char)c < 0x20)
+    {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      quoted += escaped;
+    }
+    else
+    {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+static double Percentile(std::vector<double> values, double fraction)
+{
+  if (values.empty())
+    return 0.0;
+
+  std::sort(values.begin(), values.end());
+  size_t index = (size_t)(fraction * (values.size() - 1) + 0.5);
+  return values[index];
+}
+
+static double ProcessCpuSeconds(const rusage& usage)
+{
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+int main(int argc, char** argv)
+{
+  const char* videoPath = nullptr;
+  VideoDecodeOptions decodeOptions;
+  ReadAheadOptions readAhead;
+  std::string pixelFormatName = "native";
+  std::string label;
+  bool staging = false;
+  bool withAudio = true;
+  int seekPattern = SeekNone;
+  int seekCount = 50;
+  int framesPerSeek = 30;
+  unsigned int seed = 1;
+  uint64_t maxFrames = 0;
+  double maxSeconds = 0.0;
+  const char* tracePath = nullptr;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+
+    if (arg == "--threads" && i + 1 < argc)
+    {
+      std::string value = argv[++i];
+      decodeOptions.threadCount = value == "auto" ? 0 : std::max(1, std::atoi(value.c_str()));
+    }
+    else if (arg == "--thread-type" && i + 1 < argc)
+    {
+      std::string value = argv[++i];
+      if (value == "frame")
+        decodeOptions.threadType = FF_THREAD_FRAME;
+      else if (value == "slice")
+        decodeOptions.threadType = FF_THREAD_SLICE;
+      else
+        decodeOptions.threadType = 0;
+    }
+    else if (arg == "--frame-queue" && i + 1 < argc)
+    {
+      decodeOptions.frameQueueDepth = (size_t)std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--pix-fmt" && i + 1 < argc)
+    {
+      pixelFormatName = argv[++i];
+      if (pixelFormatName != "native")
+      {
+        decodeOptions.outputFormat = av_get_pix_fmt(pixelFormatName.c_str());
+        if (decodeOptions.outputFormat == AV_PIX_FMT_NONE)
+        {
+          std::cout << "Unknown pixel format " << pixelFormatName << "\n";
+          return -1;
+        }
+      }
+    }
+    else if (arg == "--staging")
+    {
+      staging = true;
+    }
+    else if (arg == "--no-audio")
+    {
+      withAudio = false;
+    }
+    else if (arg == "--read-ahead" && i + 1 < argc)
+    {
+      std::string value = argv[++i];
+      readAhead.mode = value == "on" ? ReadAheadOn : value == "off" ? ReadAheadOff : ReadAheadAuto;
+    }
+    else if (arg == "--seek" && i + 1 < argc)
+    {
+      std::string value = argv[++i];
+      seekPattern = value == "random" ? SeekRandom : value == "scrub" ? SeekScrub : SeekNone;
+    }
+    else if (arg == "--seeks" && i + 1 < argc)
+    {
+      seekCount = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--frames-per-seek" && i + 1 < argc)
+    {
+      framesPerSeek = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--seed" && i + 1 < argc)
+    {
+      seed = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+    }
+    else if (arg == "--max-frames" && i + 1 < argc)
+    {
+      maxFrames = std::strtoull(argv[++i], nullptr, 10);
+    }
+    else if (arg == "--max-seconds" && i + 1 < argc)
+    {
+      maxSeconds = std::atof(argv[++i]);
+    }
+    else if (arg == "--trace" && i + 1 < argc)
+    {
+      tracePath = argv[++i];
+    }
+    else if (arg == "--label" && i + 1 < argc)
+    {
+      label = argv[++i];
+    }
+    else if (arg == "--help")
+    {
+      PrintUsage();
+      return 0;
+    }
+    else
+    {
+      videoPath = argv[i];
+    }
+  }
+
+  if (!videoPath)
+  {
+    std::cout << "No video file provided\n";
+    PrintUsage();
+    return -1;
+  }
+
+  if (tracePath)
+    Telemetry::Enable();
+  Telemetry::SetThreadName("bench");
+
+  auto openStart = std::chrono::steady_clock::now();
+
+  MediaSource source;
+  VideoReader video;
+  AudioReader audio;
+  AudioOutput audioOutput;
+
+  source.SetReadAhead(readAhead);
+  if (!source.Open(videoPath))
+  {
+    std::cout << "Couldn't open " << videoPath << "\n";
+    return -1;
+  }
+
+  if (!video.Open(&source, decodeOptions))
+  {
+    std::cout << "Couldn't open video in " << videoPath << "\n";
+    return -1;
+  }
+
+  // Audio is pulled by this thread at whatever rate decoding manages, at the stream's own format
+  bool hasAudio = false;
+  if (withAudio && source.GetAudioStreamIndex() >= 0)
+  {
+    const AVCodecParameters* audioParams = source.GetFormatContext()->streams[source.GetAudioStreamIndex()]->codecpar;
+    audioOutput.OpenHeadless(audioParams->sample_rate, audioParams->ch_layout.nb_channels > 1 ? 2 : 1);
+    hasAudio = audio.Open(&source, &audioOutput);
+  }
+
+  // Otherwise the demuxer would still queue the audio track, and the run would measure buffering it
+  if (!hasAudio)
+    source.DisableAudio();
+
+  // The renderer's upload-buffer path, minus the GL buffer: native frames are copied into it
+  std::vector<uint8_t> stagingStorage;
+  if (staging)
+  {
+    stagingStorage.resize(video.GetFrameSize() * decodeOptions.frameQueueDepth);
+    video.UseFrameStorage(stagingStorage.data(), decodeOptions.frameQueueDepth);
+  }
+
+  double openSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - openStart).count();
+
+  rusage usageStart;
+  getrusage(RUSAGE_SELF, &usageStart);
+  auto runStart = std::chrono::steady_clock::now();
+
+  source.Start();
+  video.StartDecoding();
+  if (hasAudio)
+  {
+    audio.PrefillBuffer();
+    audio.StartDecoding();
+    audio.Play();
+  }
+
+  std::vector<float> audioScratch(4096 * audioOutput.GetChannels());
+  uint64_t framesConsumed = 0;
+  uint64_t audioFramesPulled = 0;
+  std::vector<double> seekLatencies;
+
+  auto elapsed = [&]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count(); };
+  auto limitReached = [&]() {
+    return (maxFrames > 0 && framesConsumed >= maxFrames) || (maxSeconds > 0.0 && elapsed() >= maxSeconds);
+  };
+
+  // Takes what the readers have ready; false once there was nothing to take
+  auto drain = [&](uint64_t frameLimit) {
+    bool progressed = false;
+
+    while (framesConsumed < frameLimit && video.PeekFrame())
+    {
+      video.PopFrame();
+      video.ReleaseFrame();
+      framesConsumed++;
+      progressed = true;
+    }
+
+    if (hasAudio && !audio.IsFinished())
+    {
+      // Silence padding is not progress; counting it would spin this loop while the reader refills
+      uint32_t pulled = audioOutput.Render(audioScratch.data(), 4096);
+      audioFramesPulled += pulled;
+      if (pulled > 0)
+        progressed = true;
+    }
+
+    if (!progressed)
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    return progressed;
+  };
+
+  if (seekPattern == SeekNone)
+  {
+    while (!limitReached() && !(video.IsFinished() && (!hasAudio || audio.IsFinished())))
+      drain(UINT64_MAX);
+  }
+  else
+  {
+    std::mt19937 random(seed);
+    double duration = video.GetDuration();
+
+    for (int i = 0; i < seekCount && !limitReached(); i++)
+    {
+      double target = seekPattern == SeekRandom ?
+        std::uniform_real_distribution<double>(0.0, std::max(0.0, duration - 1.0))(random) :
+        duration * i / seekCount;
+
+      // Same sequence as the player's seek
+      auto seekStart = std::chrono::steady_clock::now();
+
+      video.StopDecoding();
+      if (hasAudio)
+        audio.StopDecoding();
+
+      if (source.Seek(target))
+        video.Seek(target);
+
+      if (hasAudio)
+      {
+        audio.Seek(target);
+        audio.PrefillBuffer();
+        audio.StartDecoding();
+      }
+      video.StartDecoding();
+
+      while (!video.PeekFrame() && !video.IsFinished())
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+
+      seekLatencies.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - seekStart).count());
+
+      uint64_t segmentEnd = framesConsumed + framesPerSeek;
+      while (framesConsumed < segmentEnd && !video.IsFinished() && !limitReached())
+        drain(segmentEnd);
+    }
+  }
+
+  double wallSeconds = elapsed();
+
+  video.StopDecoding();
+  if (hasAudio)
+    audio.StopDecoding();
+  source.Stop();
+
+  rusage usageEnd;
+  getrusage(RUSAGE_SELF, &usageEnd);
+  double cpuSeconds = ProcessCpuSeconds(usageEnd) - ProcessCpuSeconds(usageStart);
+
+  VideoDecodeStats videoStats = video.GetDecodeStats();
+  AudioDecodeStats audioStats = hasAudio ? audio.GetDecodeStats() : AudioDecodeStats();
+  DemuxStats demuxStats = source.GetDemuxStats();
+
+  AVFormatContext* formatCTX = source.GetFormatContext();
+  const AVStream* videoStream = formatCTX->streams[source.GetVideoStreamIndex()];
+  const AVCodecParameters* videoParams = videoStream->codecpar;
+  const char* decoderFormat = av_get_pix_fmt_name((AVPixelFormat)videoParams->format);
+  const char* outputFormat = av_get_pix_fmt_name(video.GetOutputFormat());
+  const char* threadType = videoStats.threadType == FF_THREAD_FRAME ? "frame" :
+                           videoStats.threadType == FF_THREAD_SLICE ? "slice" : "none";
+  const char* seekName = seekPattern == SeekRandom ? "random" : seekPattern == SeekScrub ? "scrub" : "none";
+  double videoSeconds = framesConsumed * video.GetFrameDuration();
+
+  printf("{\n");
+  printf("  \"label\": %s,\n", JsonString(label).c_str());
+  printf("  \"file\": %s,\n", JsonString(videoPath).c_str());
+  printf("  \"options\": { \"threads\": %d, \"thread_type\": %s, \"frame_queue\": %zu, \"pix_fmt\": %s, \"staging\": %s, "
+         "\"audio\": %s, \"seek\": \"%s\", \"seeks\": %d, \"frames_per_seek\": %d, \"seed\": %u },\n",
+         decodeOptions.threadCount,
+         decodeOptions.threadType == FF_THREAD_FRAME ? "\"frame\"" : decodeOptions.threadType == FF_THREAD_SLICE ? "\"slice\"" : "\"auto\"",
+         decodeOptions.frameQueueDepth, JsonString(pixelFormatName).c_str(),
+         staging ? "true" : "false", hasAudio ? "true" : "false",
+         seekName, seekCount, framesPerSeek, seed);
+  printf("  \"stream\": { \"codec\": \"%s\", \"width\": %d, \"height\": %d, \"decoder_format\": \"%s\", \"output_format\": \"%s\", "
+         "\"frame_duration\": %.6f, \"duration\": %.3f },\n",
+         avcodec_get_name(videoParams->codec_id), video.GetWidth(), video.GetHeight(),
+         decoderFormat ? decoderFormat : "unknown", outputFormat ? outputFormat : "unknown",
+         video.GetFrameDuration(), video.GetDuration());
+  printf("  \"open_seconds\": %.6f,\n", openSeconds);
+  printf("  \"probe\": { \"seconds\": %.6f, \"cached\": %s },\n", source.GetProbeSeconds(), source.WasProbeCached() ? "true" : "false");
+  printf("  \"wall_seconds\": %.6f,\n", wallSeconds);
+  printf("  \"frames\": %llu,\n", (unsigned long long)framesConsumed);
+  printf("  \"fps\": %.3f,\n", wallSeconds > 0.0 ? framesConsumed / wallSeconds : 0.0);
+  printf("  \"realtime_factor\": %.3f,\n", wallSeconds > 0.0 ? videoSeconds / wallSeconds : 0.0);
+  printf("  \"decoder\": { \"threads\": %d, \"thread_type\": \"%s\", \"frames_decoded\": %llu, \"frames_scaled\": %llu, \"frames_copied\": %llu, "
+         "\"codec_threads\": %d, \"codec_cpu_seconds\": %.6f, \"worker_cpu_seconds\": %.6f },\n",
+         videoStats.threadCount, threadType,
+         (unsigned long long)videoStats.framesDecoded,
+         (unsigned long long)videoStats.framesScaled,
+         (unsigned long long)videoStats.framesCopied,
+         videoStats.codecThreads, videoStats.codecCpuSeconds, videoStats.workerCpuSeconds);
+  printf("  \"stages\": { \"demux_seconds\": %.6f, \"decode_seconds\": %.6f, \"scale_seconds\": %.6f, \"copy_seconds\": %.6f, "
+         "\"audio_decode_seconds\": %.6f, \"audio_resample_seconds\": %.6f },\n",
+         demuxStats.readSeconds, videoStats.decodeSeconds, videoStats.scaleSeconds, videoStats.copySeconds,
+         audioStats.decodeSeconds, audioStats.resampleSeconds);
+  printf("  \"demux\": { \"packets\": %llu, \"bytes\": %llu },\n",
+         (unsigned long long)demuxStats.packets, (unsigned long long)demuxStats.bytes);
+  printf("  \"audio\": { \"samples_decoded\": %llu, \"frames_pulled\": %llu },\n",
+         (unsigned long long)audioStats.samplesDecoded, (unsigned long long)audioFramesPulled);
+
+  if (source.UsesReadAhead())
+  {
+    ReadAheadStats readStats = source.GetReadAheadStats();
+    printf("  \"read_ahead\": { \"backend\": \"%s\", \"window_bytes\": %lld, \"hits\": %llu, \"stalls\": %llu, \"misses\": %llu, "
+           "\"stall_seconds\": %.6f, \"bytes_read\": %llu, \"cancelled\": %llu },\n",
+           readStats.usingIoUring ? "io_uring" : "thread_pool", (long long)readStats.windowBytes,
+           (unsigned long long)readStats.hits, (unsigned long long)readStats.stalls, (unsigned long long)readStats.misses,
+           readStats.stallSeconds, (unsigned long long)readStats.bytesRead, (unsigned long long)readStats.cancelled);
+  }
+
+  if (!seekLatencies.empty())
+  {
+    printf("  \"seek_latency_ms\": { \"count\": %zu, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f },\n",
+           seekLatencies.size(),
+           1000.0 * Percentile(seekLatencies, 0.5),
+           1000.0 * Percentile(seekLatencies, 0.9),
+           1000.0 * Percentile(seekLatencies, 0.99),
+           1000.0 * *std::max_element(seekLatencies.begin(), seekLatencies.end()));
+  }
+
+  printf("  \"cpu_seconds\": %.6f,\n", cpuSeconds);
+  printf("  \"cpu_cores\": %.3f,\n", wallSeconds > 0.0 ? cpuSeconds / wallSeconds : 0.0);
+  printf("  \"peak_rss_mb\": %.1f\n", usageEnd.ru_maxrss / 1024.0);
+  printf("}\n");
+
+  video.Close();
+  if (hasAudio)
+    audio.Close();
+  source.Close();
+  audioOutput.Close();
+
+  if (tracePath)
+    Telemetry::WriteTrace(tracePath);
+
+  return 0;
+}
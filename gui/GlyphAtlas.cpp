@@ -0,0 +1,148 @@
+#include "GlyphAtlas.h"
+
+#include <iostream>
+#include <algorithm>
+
+GlyphAtlas::GlyphAtlas() {}
+
+GlyphAtlas::~GlyphAtlas() {
+  cleanup();
+}
+
+bool GlyphAtlas::init(const char* fontPath, int pixelSize, int size) {
+  cleanup();
+
+  if (FT_Init_FreeType(&library)) {
+    std::cerr << "Failed to initialize FreeType" << std::endl;
+    library = nullptr;
+    return false;
+  }
+
+  if (FT_New_Face(library, fontPath, 0, &face) || FT_Set_Pixel_Sizes(face, 0, pixelSize)) {
+    std::cerr << "Failed to load font: " << fontPath << std::endl;
+    cleanup();
+    return false;
+  }
+
+  // Cells fit the face's largest advance and full line height, plus a pixel so linear filtering never bleeds
+  const FT_Size_Metrics& metrics = face->size->metrics;
+  ascender = (float)(metrics.ascender >> 6);
+  lineHeight = (float)(metrics.height >> 6);
+  cellWidth = (int)(metrics.max_advance >> 6) + 1;
+  cellHeight = (int)((metrics.ascender - metrics.descender) >> 6) + 1;
+
+  atlasSize = size;
+  columns = atlasSize / cellWidth;
+  int rows = atlasSize / cellHeight;
+  if (columns <= 0 || rows <= 0) {
+    std::cerr << "Font size " << pixelSize << " does not fit a " << atlasSize << " pixel atlas" << std::endl;
+    cleanup();
+    return false;
+  }
+
+  cells.resize(columns * rows);
+
+  std::vector<uint8_t> blank(atlasSize * atlasSize, 0);
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlasSize, atlasSize, 0, GL_RED, GL_UNSIGNED_BYTE, blank.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  return true;
+}
+
+void GlyphAtlas::cleanup() {
+  if (texture != 0) {
+    glDeleteTextures(1, &texture);
+    texture = 0;
+  }
+
+  if (face) {
+    FT_Done_Face(face);
+    face = nullptr;
+  }
+  if (library) {
+    FT_Done_FreeType(library);
+    library = nullptr;
+  }
+
+  cells.clear();
+  cellOf.clear();
+  recentCells.clear();
+  cellsUsed = 0;
+}
+
+const Glyph* GlyphAtlas::getGlyph(uint32_t codepoint) {
+  if (!texture)
+    return nullptr;
+
+  auto found = cellOf.find(codepoint);
+  if (found != cellOf.end()) {
+    Cell& cell = cells[found->second];
+    recentCells.splice(recentCells.begin(), recentCells, cell.recent);
+    cell.batch = batch;
+    return &cell.glyph;
+  }
+
+  int index;
+  if (cellsUsed < (int)cells.size()) {
+    index = cellsUsed++;
+    recentCells.push_front(index);
+  } else {
+    // The batch still has to be drawn with what this cell holds
+    index = recentCells.back();
+    if (cells[index].batch == batch)
+      return nullptr;
+
+    cellOf.erase(cells[index].codepoint);
+    recentCells.splice(recentCells.begin(), recentCells, cells[index].recent);
+    evicted++;
+  }
+
+  Cell& cell = cells[index];
+  cell.recent = recentCells.begin();
+  cell.codepoint = codepoint;
+  cell.batch = batch;
+  cellOf[codepoint] = index;
+
+  rasterize(codepoint, cell, index);
+  return &cell.glyph;
+}
+
+bool GlyphAtlas::rasterize(uint32_t codepoint, Cell& cell, int index) {
+  cell.glyph = Glyph{ glm::vec2(0.0f), glm::vec2(0.0f), 0.0f, glm::vec2(0.0f), glm::vec2(0.0f) };
+
+  if (FT_Load_Char(face, codepoint, FT_LOAD_RENDER))
+    return false;
+
+  FT_GlyphSlot slot = face->glyph;
+  int width = std::min((int)slot->bitmap.width, cellWidth - 1);
+  int height = std::min((int)slot->bitmap.rows, cellHeight - 1);
+  int x = (index % columns) * cellWidth;
+  int y = (index / columns) * cellHeight;
+
+  // Clear the whole cell so nothing of an evicted glyph is left around the new one
+  std::vector<uint8_t> pixels(cellWidth * cellHeight, 0);
+  for (int row = 0; row < height; row++)
+    std::copy_n(slot->bitmap.buffer + row * slot->bitmap.pitch, width, pixels.data() + row * cellWidth);
+
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, cellWidth, cellHeight, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  cell.glyph.size = glm::vec2((float)width, (float)height);
+  cell.glyph.bearing = glm::vec2((float)slot->bitmap_left, (float)slot->bitmap_top);
+  cell.glyph.advance = (float)(slot->advance.x >> 6);
+  cell.glyph.uvMin = glm::vec2((float)x / atlasSize, (float)y / atlasSize);
+  cell.glyph.uvMax = glm::vec2((float)(x + width) / atlasSize, (float)(y + height) / atlasSize);
+
+  rasterized++;
+  return true;
+}
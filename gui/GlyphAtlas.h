@@ -0,0 +1,78 @@
+#pragma once
+
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+struct Glyph {
+  glm::vec2 size;
+  glm::vec2 bearing;    // from the pen position on the baseline to the bitmap's top left
+  float advance;
+  glm::vec2 uvMin;
+  glm::vec2 uvMax;
+};
+
+// Glyphs of one face at one pixel size, rasterized by FreeType on first use
+// into fixed cells of a single-channel atlas texture. When every cell is taken
+// the least recently used glyph gives up its cell.
+class GlyphAtlas {
+  private:
+    struct Cell {
+      uint32_t codepoint = 0;
+      Glyph glyph;
+      uint64_t batch = 0;
+      std::list<int>::iterator recent;
+    };
+
+    FT_Library library = nullptr;
+    FT_Face face = nullptr;
+
+    unsigned int texture = 0;
+    int atlasSize = 0;
+    int cellWidth = 0;
+    int cellHeight = 0;
+    int columns = 0;
+
+    float lineHeight = 0.0f;
+    float ascender = 0.0f;
+
+    std::vector<Cell> cells;
+    int cellsUsed = 0;
+    std::unordered_map<uint32_t, int> cellOf;
+    std::list<int> recentCells;     // most recent first
+    uint64_t batch = 1;
+
+    size_t rasterized = 0;
+    size_t evicted = 0;
+
+    bool rasterize(uint32_t codepoint, Cell& cell, int index);
+
+  public:
+    GlyphAtlas();
+    ~GlyphAtlas();
+
+    bool init(const char* fontPath, int pixelSize, int size = 512);
+    void cleanup();
+    bool isReady() const { return texture != 0; }
+
+    // nullptr when the only cell left to evict holds a glyph of the current batch;
+    // draw the batch, call nextBatch and ask again
+    const Glyph* getGlyph(uint32_t codepoint);
+    void nextBatch() { batch++; }
+
+    unsigned int getTexture() const { return texture; }
+    float getLineHeight() const { return lineHeight; }
+    float getAscender() const { return ascender; }
+
+    size_t getCellCount() const { return cells.size(); }
+    size_t getCellsUsed() const { return cellsUsed; }
+    size_t getRasterized() const { return rasterized; }
+    size_t getEvicted() const { return evicted; }
+};
@@ -0,0 +1,127 @@
+#include "IconAtlas.h"
+
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+
+#include "stb/stb_image.h"
+
+// Transparent texels left around every image so linear filtering never picks up a neighbour
+static const int ICON_PADDING = 1;
+
+IconAtlas::IconAtlas() {}
+
+IconAtlas::~IconAtlas() {
+  cleanup();
+}
+
+int IconAtlas::add(const char* filepath) {
+  int imageWidth, imageHeight, channels;
+  stbi_set_flip_vertically_on_load(true);
+  unsigned char* data = stbi_load(filepath, &imageWidth, &imageHeight, &channels, 4);
+  if (!data) {
+    std::cerr << "Failed to load icon: " << filepath << std::endl;
+    return -1;
+  }
+
+  Image image;
+  image.width = imageWidth;
+  image.height = imageHeight;
+  image.pixels.assign(data, data + (size_t)imageWidth * imageHeight * 4);
+  stbi_image_free(data);
+
+  images.push_back(std::move(image));
+  return (int)images.size() - 1;
+}
+
+int IconAtlas::pack(int atlasWidth, std::vector<glm::ivec2>& positions) const {
+  std::vector<int> order(images.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return images[a].height > images[b].height; });
+
+  positions.assign(images.size(), glm::ivec2(0));
+  int x = 0, y = 0, shelfHeight = 0;
+  for (int index : order) {
+    int cellWidth = images[index].width + ICON_PADDING * 2;
+    int cellHeight = images[index].height + ICON_PADDING * 2;
+
+    if (x + cellWidth > atlasWidth) {
+      x = 0;
+      y += shelfHeight;
+      shelfHeight = 0;
+    }
+
+    positions[index] = glm::ivec2(x + ICON_PADDING, y + ICON_PADDING);
+    x += cellWidth;
+    shelfHeight = std::max(shelfHeight, cellHeight);
+  }
+
+  return y + shelfHeight;
+}
+
+bool IconAtlas::build() {
+  if (images.empty())
+    return false;
+
+  // Narrowest power of two that is at least as wide as the packing is tall
+  int atlasWidth = 64;
+  for (const Image& image : images)
+    while (atlasWidth < image.width + ICON_PADDING * 2)
+      atlasWidth *= 2;
+
+  std::vector<glm::ivec2> positions;
+  int atlasHeight = pack(atlasWidth, positions);
+  while (atlasHeight > atlasWidth) {
+    atlasWidth *= 2;
+    atlasHeight = pack(atlasWidth, positions);
+  }
+
+  std::vector<unsigned char> pixels((size_t)atlasWidth * atlasHeight * 4, 0);
+  icons.assign(images.size(), Icon());
+  for (size_t i = 0; i < images.size(); i++) {
+    const Image& image = images[i];
+    glm::ivec2 position = positions[i];
+    for (int row = 0; row < image.height; row++)
+      memcpy(pixels.data() + ((size_t)(position.y + row) * atlasWidth + position.x) * 4,
+             image.pixels.data() + (size_t)row * image.width * 4, (size_t)image.width * 4);
+
+    icons[i].uvMin = glm::vec2((float)position.x / atlasWidth, (float)position.y / atlasHeight);
+    icons[i].uvMax = glm::vec2((float)(position.x + image.width) / atlasWidth, (float)(position.y + image.height) / atlasHeight);
+  }
+
+  if (texture == 0)
+    glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, atlasWidth, atlasHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+  for (Icon& icon : icons)
+    icon.texture = texture;
+
+  width = atlasWidth;
+  height = atlasHeight;
+  images.clear();
+  return true;
+}
+
+void IconAtlas::cleanup() {
+  if (texture != 0) {
+    glDeleteTextures(1, &texture);
+    texture = 0;
+  }
+
+  images.clear();
+  icons.clear();
+  width = 0;
+  height = 0;
+}
+
+const Icon& IconAtlas::get(int id) const {
+  if (id < 0 || id >= (int)icons.size())
+    return missing;
+  return icons[id];
+}
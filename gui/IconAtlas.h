@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Where an icon is: a texture and the part of it to draw
+struct Icon {
+  unsigned int texture = 0;
+  glm::vec2 uvMin = glm::vec2(0.0f);
+  glm::vec2 uvMax = glm::vec2(1.0f);
+};
+
+// Images loaded at startup and packed into one RGBA texture, so every icon
+// samples the same texture and the UI draws them without rebinding.
+// Rows are kept in load order, bottom row first, like UIRenderer::loadTexture.
+class IconAtlas {
+  private:
+    struct Image {
+      int width = 0;
+      int height = 0;
+      std::vector<unsigned char> pixels;
+    };
+
+    std::vector<Image> images;
+    std::vector<Icon> icons;
+    Icon missing;
+
+    unsigned int texture = 0;
+    int width = 0;
+    int height = 0;
+
+    // Shelves of images sorted tallest first; fills positions and returns the height used
+    int pack(int atlasWidth, std::vector<glm::ivec2>& positions) const;
+
+  public:
+    IconAtlas();
+    ~IconAtlas();
+
+    // Loads the image and returns its id, or -1 if it could not be read;
+    // the id's Icon is valid once build() has uploaded the atlas
+    int add(const char* filepath);
+    bool build();
+    void cleanup();
+
+    // An unknown id gives an Icon with no texture
+    const Icon& get(int id) const;
+    unsigned int getTexture() const { return texture; }
+    glm::ivec2 getSize() const { return glm::ivec2(width, height); }
+};
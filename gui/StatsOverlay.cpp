@@ -0,0 +1,56 @@
+#include "StatsOverlay.h"
+
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+void StatsOverlay::render(UIRenderer* renderer, const PlaybackStats& stats, const glm::vec2& topLeft) {
+  if (!visible || !renderer->hasText())
+    return;
+
+  std::vector<std::string> lines;
+  char line[160];
+
+  snprintf(line, sizeof(line), "%dx%d %s -> %s", stats.width, stats.height, stats.codec.c_str(), stats.pixelFormat.c_str());
+  lines.push_back(line);
+  snprintf(line, sizeof(line), "decode %6.1f fps   present %6.1f fps", stats.decodeFps, stats.presentFps);
+  lines.push_back(line);
+  snprintf(line, sizeof(line), "dropped %llu   skipped %llu   decimated %llu   skip level %d",
+           (unsigned long long)stats.framesDropped, (unsigned long long)stats.framesSkipped,
+           (unsigned long long)stats.framesDecimated, stats.skipLevel);
+  lines.push_back(line);
+  snprintf(line, sizeof(line), "frames %zu/%zu   packets video %zu audio %zu",
+           stats.framesQueued, stats.queueDepth, stats.videoPackets, stats.audioPackets);
+  lines.push_back(line);
+  if (stats.hasAudio) {
+    snprintf(line, sizeof(line), "audio buffered %5.0f ms", stats.audioBufferedMs);
+    lines.push_back(line);
+  }
+  snprintf(line, sizeof(line), "A/V drift %+6.1f ms   max %5.1f ms", stats.driftMs, stats.driftMaxMs);
+  lines.push_back(line);
+  snprintf(line, sizeof(line), "upload %5.2f ms   GPU %5.2f ms", stats.uploadMs, stats.gpuMs);
+  lines.push_back(line);
+
+  const GlyphAtlas& atlas = renderer->getGlyphAtlas();
+  snprintf(line, sizeof(line), "glyphs %zu/%zu   evicted %zu",
+           atlas.getCellsUsed(), atlas.getCellCount(), atlas.getEvicted());
+  lines.push_back(line);
+  snprintf(line, sizeof(line), "UI %zu draws   %zu vertices", renderer->getLastDrawCalls(), renderer->getLastVertexCount());
+  lines.push_back(line);
+
+  float padding = 10.0f;
+  float lineHeight = renderer->getLineHeight();
+  float width = 0.0f;
+  for (const std::string& text : lines)
+    width = std::max(width, renderer->measureText(text).x);
+
+  glm::vec2 panelSize(width + padding * 2.0f, lines.size() * lineHeight + padding * 2.0f);
+  renderer->renderFilledAABB(AABB(topLeft + glm::vec2(panelSize.x, -panelSize.y) * 0.5f, panelSize, 8.0f),
+                             glm::vec4(0.0f, 0.0f, 0.0f, 0.7f));
+
+  glm::vec2 baseline = topLeft + glm::vec2(padding, -padding - renderer->getGlyphAtlas().getAscender());
+  for (const std::string& text : lines) {
+    renderer->renderText(text, baseline, glm::vec4(0.9f, 0.9f, 0.9f, 1.0f));
+    baseline.y -= lineHeight;
+  }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "UIRenderer.h"
+
+// What the statistics overlay shows, gathered by the player
+struct PlaybackStats {
+  int width = 0;
+  int height = 0;
+  std::string codec;
+  std::string pixelFormat;
+
+  double decodeFps = 0.0;
+  double presentFps = 0.0;
+  uint64_t framesDropped = 0;
+  uint64_t framesSkipped = 0;
+  uint64_t framesDecimated = 0;
+  int skipLevel = 0;
+
+  size_t framesQueued = 0;
+  size_t queueDepth = 0;
+  size_t videoPackets = 0;
+  size_t audioPackets = 0;
+  bool hasAudio = false;
+  double audioBufferedMs = 0.0;
+
+  double driftMs = 0.0;
+  double driftMaxMs = 0.0;
+  double uploadMs = 0.0;
+  double gpuMs = 0.0;
+};
+
+// Text panel of playback statistics, anchored at its top left corner
+class StatsOverlay {
+  public:
+    bool visible = false;
+
+    void render(UIRenderer* renderer, const PlaybackStats& stats, const glm::vec2& topLeft);
+};
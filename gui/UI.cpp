@@ -123,6 +123,14 @@ bool UI::button(UIRenderer* renderer, vec4 color, vec2 size, float cornerRadius,
 
 bool UI::textureButton(UIRenderer* renderer, unsigned int textureID, vec2 size, 
                        ID id, const vec4& color, const vec4& tintColor)
+{
+  Icon icon;
+  icon.texture = textureID;
+  return textureButton(renderer, icon, size, id, color, tintColor);
+}
+
+bool UI::textureButton(UIRenderer* renderer, const Icon& icon, vec2 size,
+                       ID id, const vec4& color, const vec4& tintColor)
 {
   auto layout = topLayout();
   assert(layout != NULL);
@@ -157,7 +165,7 @@ bool UI::textureButton(UIRenderer* renderer, unsigned int textureID, vec2 size,
   else if (hot == id)
     finalTint = vec4(vec3(tintColor) * 0.9f, tintColor.a);
 
-  renderer->renderTexturedAABB(rect, textureID, finalTint, color);
+  renderer->renderTexturedAABB(rect, icon.texture, finalTint, color, icon.uvMin, icon.uvMax);
   layout->pushWidget(size);
 
   return clicked;
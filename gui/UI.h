@@ -6,6 +6,7 @@
 #include <glm/glm.hpp>
 
 #include "UIRenderer.h"
+#include "IconAtlas.h"
 
 using namespace glm;
 
@@ -48,6 +49,8 @@ struct UI
   bool button(UIRenderer* renderer, vec4 color, vec2 size, float cornerRadius, size_t id);
   bool textureButton(UIRenderer* renderer, unsigned int textureID, vec2 size, size_t id, 
                      const vec4& color = vec4(1.0f), const vec4& tintColor = vec4(1.0f));
+  bool textureButton(UIRenderer* renderer, const Icon& icon, vec2 size, size_t id,
+                     const vec4& color = vec4(1.0f), const vec4& tintColor = vec4(1.0f));
   bool slider(UIRenderer* renderer, float& value, vec2 size, float cornerRadius, 
       vec4 trackColor, vec4 fillColor, vec4 scrubberColor, size_t id);
 
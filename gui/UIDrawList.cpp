@@ -0,0 +1,64 @@
+#include "UIDrawList.h"
+
+#include <algorithm>
+
+void UIDrawList::clear() {
+  vertices.clear();
+  commands.clear();
+}
+
+void UIDrawList::beginRun(unsigned int texture, uint32_t count) {
+  if (!commands.empty()) {
+    UIDrawCommand& last = commands.back();
+    if (texture == 0 || last.texture == texture || last.texture == 0) {
+      if (texture != 0)
+        last.texture = texture;
+      last.count += count;
+      return;
+    }
+  }
+
+  commands.push_back(UIDrawCommand{ texture, (uint32_t)vertices.size(), count });
+}
+
+void UIDrawList::addVertex(const glm::vec2& position, const glm::vec2& uv, const glm::vec4& color, Mode mode, const glm::vec4& shape) {
+  vertices.push_back(UIVertex{ position, uv, color, (float)mode, shape });
+}
+
+void UIDrawList::addQuad(const glm::vec2& min, const glm::vec2& max, const glm::vec4& color,
+                         Mode mode, unsigned int texture, const glm::vec2& uvMin, const glm::vec2& uvMax) {
+  beginRun(mode == SOLID ? 0 : texture, 6);
+
+  addVertex(glm::vec2(min.x, max.y), glm::vec2(uvMin.x, uvMin.y), color, mode);
+  addVertex(glm::vec2(min.x, min.y), glm::vec2(uvMin.x, uvMax.y), color, mode);
+  addVertex(glm::vec2(max.x, min.y), glm::vec2(uvMax.x, uvMax.y), color, mode);
+  addVertex(glm::vec2(min.x, max.y), glm::vec2(uvMin.x, uvMin.y), color, mode);
+  addVertex(glm::vec2(max.x, min.y), glm::vec2(uvMax.x, uvMax.y), color, mode);
+  addVertex(glm::vec2(max.x, max.y), glm::vec2(uvMax.x, uvMin.y), color, mode);
+}
+
+// The quad reaches margin pixels past the shape so the fade at its edge is not cut off
+void UIDrawList::addShape(const glm::vec2& center, const glm::vec4& shape, float margin, const glm::vec4& color, Mode mode) {
+  beginRun(0, 6);
+
+  glm::vec2 extent = glm::vec2(shape.x, shape.y) + margin;
+  glm::vec2 corners[6] = {
+    glm::vec2(-extent.x,  extent.y), glm::vec2(-extent.x, -extent.y), glm::vec2( extent.x, -extent.y),
+    glm::vec2(-extent.x,  extent.y), glm::vec2( extent.x, -extent.y), glm::vec2( extent.x,  extent.y),
+  };
+  for (const glm::vec2& corner : corners)
+    addVertex(center + corner, corner, color, mode, shape);
+}
+
+void UIDrawList::addRoundedRect(const glm::vec2& center, const glm::vec2& size, float radius, const glm::vec4& color, float borderWidth) {
+  glm::vec2 halfSize = size * 0.5f;
+  radius = glm::clamp(radius, 0.0f, std::min(halfSize.x, halfSize.y));
+  addShape(center, glm::vec4(halfSize.x, halfSize.y, radius, borderWidth), 1.0f, color, ROUNDED);
+}
+
+void UIDrawList::addShadow(const glm::vec2& center, const glm::vec2& size, float radius, float softness, const glm::vec4& color) {
+  glm::vec2 halfSize = size * 0.5f;
+  radius = glm::clamp(radius, 0.0f, std::min(halfSize.x, halfSize.y));
+  softness = std::max(softness, 1.0f);
+  addShape(center, glm::vec4(halfSize.x, halfSize.y, radius, softness), softness, color, SHADOW);
+}
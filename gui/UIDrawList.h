@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+struct UIVertex {
+  glm::vec2 position;
+  glm::vec2 uv;
+  glm::vec4 color;
+  float mode;     // UIDrawList::Mode, how the fragment uses the texture
+  glm::vec4 shape; // ROUNDED and SHADOW: half size, corner radius, border width or softness
+};
+
+// Vertices drawn with one texture bound
+struct UIDrawCommand {
+  unsigned int texture;
+  uint32_t first;
+  uint32_t count;
+};
+
+// A frame's UI as triangles in draw order, recorded on the CPU and submitted
+// by UIRenderer in one upload. Solid geometry and shapes sample nothing, so they join
+// whatever run is open; a new command only starts when the texture changes.
+class UIDrawList {
+  public:
+    enum Mode {
+      SOLID = 0,
+      TEXTURED,   // texture times color
+      GLYPH,      // color with the texture's red channel as coverage
+      ROUNDED,    // rounded rect distance field, uv is the offset from its center
+      SHADOW,     // rounded rect faded out over softness pixels either side of its edge
+    };
+
+    void clear();
+    bool empty() const { return vertices.empty(); }
+
+    // min is the bottom left corner; the top edge samples uvMin.y, as images are stored top row first
+    void addQuad(const glm::vec2& min, const glm::vec2& max, const glm::vec4& color,
+                 Mode mode = SOLID, unsigned int texture = 0,
+                 const glm::vec2& uvMin = glm::vec2(0.0f), const glm::vec2& uvMax = glm::vec2(1.0f));
+
+    // One quad each, edges antialiased in the shader; borderWidth 0 fills, otherwise only
+    // that many pixels inside the edge are drawn. radius is clamped to half the smaller side
+    void addRoundedRect(const glm::vec2& center, const glm::vec2& size, float radius, const glm::vec4& color, float borderWidth = 0.0f);
+    void addShadow(const glm::vec2& center, const glm::vec2& size, float radius, float softness, const glm::vec4& color);
+
+    const std::vector<UIVertex>& getVertices() const { return vertices; }
+    const std::vector<UIDrawCommand>& getCommands() const { return commands; }
+
+  private:
+    std::vector<UIVertex> vertices;
+    std::vector<UIDrawCommand> commands;
+
+    void beginRun(unsigned int texture, uint32_t count);
+    void addVertex(const glm::vec2& position, const glm::vec2& uv, const glm::vec4& color, Mode mode,
+                   const glm::vec4& shape = glm::vec4(0.0f));
+    void addShape(const glm::vec2& center, const glm::vec4& shape, float margin, const glm::vec4& color, Mode mode);
+};
@@ -1,13 +1,13 @@
 #include "UIRenderer.h"
 
 #include <iostream>
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
 
 #include "stb/stb_image.h"
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
 AABB::AABB() 
   : position(0.0f, 0.0f), size(1.0f, 1.0f), cornerRadius(0.0f) {}
 
@@ -56,7 +56,8 @@ glm::vec2 AABB::getBottomRight() const {
   return glm::vec2(position.x + size.x * 0.5f, position.y - size.y * 0.5f);
 }
 
-UIRenderer::UIRenderer() : VAO(0), VBO(0), EBO(0), shaderProgram(0), textureShaderProgram(0), initialized(false), projection(glm::mat4(1.0f)) {}
+UIRenderer::UIRenderer() : VAO(0), VBO(0), shaderProgram(0), projectionLocation(-1), initialized(false), projection(glm::mat4(1.0f)),
+                           streamMapping(nullptr), regionCapacity(0), streamRegion(0), regionFences(), lastDrawCalls(0), lastVertexCount(0) {}
 
 UIRenderer::~UIRenderer() {
   cleanup();
@@ -66,23 +67,66 @@ void UIRenderer::compileShader() {
   const char* vertexShaderSource = R"(
         #version 330 core
         layout (location = 0) in vec2 aPos;
+        layout (location = 1) in vec2 aTexCoord;
+        layout (location = 2) in vec4 aColor;
+        layout (location = 3) in float aMode;
+        layout (location = 4) in vec4 aShape;
+
+        out vec2 TexCoord;
+        out vec4 Color;
+        flat out int Mode;
+        flat out vec4 Shape;
 
-        uniform mat4 model;
         uniform mat4 projection;
 
         void main() {
-            gl_Position = projection * model * vec4(aPos, 0.0, 1.0);
+            gl_Position = projection * vec4(aPos, 0.0, 1.0);
+            TexCoord = aTexCoord;
+            Color = aColor;
+            Mode = int(aMode + 0.5);
+            Shape = aShape;
         }
     )";
 
+  // Modes follow UIDrawList::Mode
   const char* fragmentShaderSource = R"(
         #version 330 core
         out vec4 FragColor;
 
-        uniform vec4 color;
+        in vec2 TexCoord;
+        in vec4 Color;
+        flat in int Mode;
+        flat in vec4 Shape;
+
+        uniform sampler2D textureSampler;
+
+        // Signed distance to a rounded rect centered on the origin, negative inside
+        float roundedRectDistance(vec2 p, vec2 halfSize, float radius) {
+            vec2 q = abs(p) - halfSize + radius;
+            return length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - radius;
+        }
 
         void main() {
-            FragColor = color;
+            // Size of a screen pixel in the shape's units, taken before branching
+            float pixel = max(length(fwidth(TexCoord)) * 0.7071, 0.0001);
+
+            if (Mode == 1)
+                FragColor = texture(textureSampler, TexCoord) * Color;
+            else if (Mode == 2)
+                FragColor = vec4(Color.rgb, Color.a * texture(textureSampler, TexCoord).r);
+            else if (Mode == 3) {
+                float d = roundedRectDistance(TexCoord, Shape.xy, Shape.z);
+                float coverage = clamp(0.5 - d / pixel, 0.0, 1.0);
+                if (Shape.w > 0.0)
+                    coverage *= clamp(0.5 + (d + Shape.w) / pixel, 0.0, 1.0);
+                FragColor = vec4(Color.rgb, Color.a * coverage);
+            }
+            else if (Mode == 4) {
+                float d = roundedRectDistance(TexCoord, Shape.xy, Shape.z);
+                FragColor = vec4(Color.rgb, Color.a * (1.0 - smoothstep(-Shape.w, Shape.w, d)));
+            }
+            else
+                FragColor = Color;
         }
     )";
 
@@ -121,321 +165,300 @@ void UIRenderer::compileShader() {
 
   glDeleteShader(vertexShader);
   glDeleteShader(fragmentShader);
-}
-
-void UIRenderer::compileTextureShader() {
-  const char* vertexShaderSource = R"(
-        #version 330 core
-        layout (location = 0) in vec2 aPos;
-        layout (location = 1) in vec2 aTexCoord;
-
-        out vec2 TexCoord;
-
-        uniform mat4 model;
-        uniform mat4 projection;
 
-        void main() {
-            gl_Position = projection * model * vec4(aPos, 0.0, 1.0);
-            TexCoord = aTexCoord;
-        }
-    )";
-
-  const char* fragmentShaderSource = R"(
-        #version 330 core
-        out vec4 FragColor;
+  // Looked up once; the sampler never leaves unit 0
+  projectionLocation = glGetUniformLocation(shaderProgram, "projection");
+  glUseProgram(shaderProgram);
+  glUniform1i(glGetUniformLocation(shaderProgram, "textureSampler"), 0);
+  glUseProgram(0);
+}
 
-        in vec2 TexCoord;
+void UIRenderer::setupBuffers() {
+  glGenVertexArrays(1, &VAO);
+  allocateStream(16 * 1024);
+}
 
-        uniform sampler2D textureSampler;
-        uniform vec4 tintColor;
-        uniform vec4 colorMult;
+void UIRenderer::allocateStream(size_t vertexCapacity) {
+  releaseStream();
 
-        void main() {
-            vec4 texColor = texture(textureSampler, TexCoord);
-            FragColor = texColor * tintColor * colorMult;
-        }
-    )";
+  regionCapacity = vertexCapacity;
+  streamRegion = 0;
+  GLsizeiptr size = (GLsizeiptr)(regionCapacity * STREAM_REGIONS * sizeof(UIVertex));
 
-  unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-  glCompileShader(vertexShader);
+  glGenBuffers(1, &VBO);
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
-  int success;
-  char infoLog[512];
-  glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-  if (!success) {
-    glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-    std::cerr << "ERROR::TEXTURE_SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+  if (GLAD_GL_VERSION_4_4) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+    streamMapping = (UIVertex*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
   }
 
-  unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-  glCompileShader(fragmentShader);
-
-  glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-  if (!success) {
-    glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-    std::cerr << "ERROR::TEXTURE_SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+  // Without a mapping the buffer is respecified every flush instead
+  if (!streamMapping) {
+    glDeleteBuffers(1, &VBO);
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
   }
 
-  textureShaderProgram = glCreateProgram();
-  glAttachShader(textureShaderProgram, vertexShader);
-  glAttachShader(textureShaderProgram, fragmentShader);
-  glLinkProgram(textureShaderProgram);
-
-  glGetProgramiv(textureShaderProgram, GL_LINK_STATUS, &success);
-  if (!success) {
-    glGetProgramInfoLog(textureShaderProgram, 512, NULL, infoLog);
-    std::cerr << "ERROR::TEXTURE_SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-  }
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(UIVertex), (void*)offsetof(UIVertex, position));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(UIVertex), (void*)offsetof(UIVertex, uv));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(UIVertex), (void*)offsetof(UIVertex, color));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(UIVertex), (void*)offsetof(UIVertex, mode));
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(UIVertex), (void*)offsetof(UIVertex, shape));
+  glEnableVertexAttribArray(4);
 
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
+  glBindVertexArray(0);
 }
 
-void UIRenderer::setupBuffers() {
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
-
-  glBindVertexArray(VAO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-  glEnableVertexAttribArray(0);
+void UIRenderer::releaseStream() {
+  for (GLsync& fence : regionFences) {
+    if (fence) {
+      glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
 
-  glBindVertexArray(0);
+  if (VBO) {
+    if (streamMapping) {
+      glBindBuffer(GL_ARRAY_BUFFER, VBO);
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      streamMapping = nullptr;
+    }
+    glDeleteBuffers(1, &VBO);
+    VBO = 0;
+  }
 }
 
 void UIRenderer::init() {
   if (initialized) return;
 
   compileShader();
-  compileTextureShader();
   setupBuffers();
   initialized = true;
 }
 
 void UIRenderer::setProjection(const glm::mat4& proj) {
+  // Vertices are recorded in screen space, so what is pending goes out under the old projection
+  if (proj != projection)
+    flush();
   projection = proj;
 }
 
-std::vector<glm::vec2> generateRoundedRectVertices(float width, float height, float radius, int segments) {
-  std::vector<glm::vec2> vertices;
-
-  float maxRadius = std::min(width, height) * 0.5f;
-  radius = std::min(radius, maxRadius);
+bool UIRenderer::initText(const char* fontPath, int pixelSize) {
+  if (fontPath)
+    return glyphAtlas.init(fontPath, pixelSize);
+
+  const char* candidates[] = {
+    "assets/font.ttf",
+    "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf",
+    "/usr/share/fonts/dejavu-sans-mono-fonts/DejaVuSansMono.ttf",
+    "/usr/share/fonts/TTF/DejaVuSansMono.ttf",
+    "/usr/share/fonts/truetype/liberation/LiberationMono-Regular.ttf",
+    "/usr/share/fonts/liberation-mono/LiberationMono-Regular.ttf",
+  };
 
-  float halfW = width * 0.5f;
-  float halfH = height * 0.5f;
+  for (const char* candidate : candidates) {
+    FILE* file = fopen(candidate, "rb");
+    if (!file)
+      continue;
+    fclose(file);
 
-  for (int i = 0; i <= segments; i++) {
-    float angle = (float)i / segments * M_PI * 0.5f;
-    float x = (halfW - radius) + radius * cos(angle);
-    float y = (halfH - radius) + radius * sin(angle);
-    vertices.push_back(glm::vec2(x, y));
+    if (glyphAtlas.init(candidate, pixelSize))
+      return true;
   }
 
-  for (int i = 0; i <= segments; i++) {
-    float angle = M_PI * 0.5f + (float)i / segments * M_PI * 0.5f;
-    float x = (-halfW + radius) + radius * cos(angle);
-    float y = (halfH - radius) + radius * sin(angle);
-    vertices.push_back(glm::vec2(x, y));
-  }
-
-  for (int i = 0; i <= segments; i++) {
-    float angle = M_PI + (float)i / segments * M_PI * 0.5f;
-    float x = (-halfW + radius) + radius * cos(angle);
-    float y = (-halfH + radius) + radius * sin(angle);
-    vertices.push_back(glm::vec2(x, y));
-  }
+  return false;
+}
 
-  for (int i = 0; i <= segments; i++) {
-    float angle = M_PI * 1.5f + (float)i / segments * M_PI * 0.5f;
-    float x = (halfW - radius) + radius * cos(angle);
-    float y = (-halfH + radius) + radius * sin(angle);
-    vertices.push_back(glm::vec2(x, y));
+// Next code point of UTF-8 text; malformed bytes come out as U+FFFD one at a time
+static uint32_t nextCodepoint(const std::string& text, size_t& i) {
+  unsigned char lead = text[i++];
+  if (lead < 0x80)
+    return lead;
+
+  int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : -1;
+  if (extra < 0 || i + extra > text.size())
+    return 0xFFFD;
+
+  uint32_t codepoint = lead & (0x3F >> extra);
+  for (int k = 0; k < extra; k++) {
+    unsigned char next = text[i];
+    if ((next & 0xC0) != 0x80)
+      return 0xFFFD;
+    codepoint = (codepoint << 6) | (next & 0x3F);
+    i++;
   }
-
-  return vertices;
+  return codepoint;
 }
 
-void UIRenderer::renderAABB(const AABB& aabb, const glm::vec4 color) {
-  if (!initialized) {
-    std::cerr << "UIRenderer not initialized!" << std::endl;
+void UIRenderer::renderText(const std::string& text, const glm::vec2& position, const glm::vec4& color) {
+  if (!initialized || !glyphAtlas.isReady())
     return;
-  }
 
-  glUseProgram(shaderProgram);
-
-  glm::mat4 model = glm::mat4(1.0f);
-  model = glm::translate(model, glm::vec3(aabb.position, 0.0f));
-
-  int modelLoc = glGetUniformLocation(shaderProgram, "model");
-  int projLoc = glGetUniformLocation(shaderProgram, "projection");
-  int colorLoc = glGetUniformLocation(shaderProgram, "color");
+  glm::vec2 pen = position;
+  size_t i = 0;
+  while (i < text.size()) {
+    uint32_t codepoint = nextCodepoint(text, i);
+    if (codepoint == '\n') {
+      pen = glm::vec2(position.x, pen.y - glyphAtlas.getLineHeight());
+      continue;
+    }
 
-  glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
-  glUniformMatrix4fv(projLoc, 1, GL_FALSE, &projection[0][0]);
-  glUniform4fv(colorLoc, 1, &color[0]);
+    const Glyph* glyph = glyphAtlas.getGlyph(codepoint);
+    if (!glyph) {
+      // The atlas needs a cell the recorded geometry still uses
+      flush();
+      glyph = glyphAtlas.getGlyph(codepoint);
+      if (!glyph)
+        continue;
+    }
 
-  if (aabb.cornerRadius > 0.0f) {
-    int segments = 32;
-    std::vector<glm::vec2> vertices = generateRoundedRectVertices(aabb.size.x, aabb.size.y, aabb.cornerRadius, segments);
+    if (glyph->size.x > 0.0f && glyph->size.y > 0.0f) {
+      glm::vec2 topLeft = pen + glm::vec2(glyph->bearing.x, glyph->bearing.y);
+      drawList.addQuad(glm::vec2(topLeft.x, topLeft.y - glyph->size.y), glm::vec2(topLeft.x + glyph->size.x, topLeft.y),
+                       color, UIDrawList::GLYPH, glyphAtlas.getTexture(), glyph->uvMin, glyph->uvMax);
+    }
 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2), vertices.data(), GL_DYNAMIC_DRAW);
+    pen.x += glyph->advance;
+  }
+}
 
-    glDrawArrays(GL_LINE_LOOP, 0, vertices.size());
-    glBindVertexArray(0);
-  } else {
-    float vertices[] = {
-      -aabb.size.x * 0.5f, -aabb.size.y * 0.5f,
-      aabb.size.x * 0.5f, -aabb.size.y * 0.5f,
-      aabb.size.x * 0.5f,  aabb.size.y * 0.5f,
-      -aabb.size.x * 0.5f,  aabb.size.y * 0.5f
-    };
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
+glm::vec2 UIRenderer::measureText(const std::string& text) {
+  float width = 0.0f;
+  float lineWidth = 0.0f;
+  int lines = 1;
+
+  size_t i = 0;
+  while (i < text.size()) {
+    uint32_t codepoint = nextCodepoint(text, i);
+    if (codepoint == '\n') {
+      width = std::max(width, lineWidth);
+      lineWidth = 0.0f;
+      lines++;
+      continue;
+    }
 
-    glDrawArrays(GL_LINE_LOOP, 0, 4);
-    glBindVertexArray(0);
+    const Glyph* glyph = glyphAtlas.getGlyph(codepoint);
+    if (!glyph) {
+      flush();
+      glyph = glyphAtlas.getGlyph(codepoint);
+    }
+    if (glyph)
+      lineWidth += glyph->advance;
   }
+
+  return glm::vec2(std::max(width, lineWidth), lines * glyphAtlas.getLineHeight());
 }
 
-void UIRenderer::renderFilledAABB(const AABB& aabb, const glm::vec4& color) {
-  if (!initialized) {
-    std::cerr << "UIRenderer not initialized!" << std::endl;
+void UIRenderer::flush() {
+  if (!initialized || drawList.empty()) {
+    lastDrawCalls = 0;
+    lastVertexCount = 0;
+    // glyphs touched this frame must still age out of the atlas
+    glyphAtlas.nextBatch();
     return;
   }
 
-  glUseProgram(shaderProgram);
-
-  glm::mat4 model = glm::mat4(1.0f);
-  model = glm::translate(model, glm::vec3(aabb.position, 0.0f));
-
-  int modelLoc = glGetUniformLocation(shaderProgram, "model");
-  int projLoc = glGetUniformLocation(shaderProgram, "projection");
-  int colorLoc = glGetUniformLocation(shaderProgram, "color");
-
-  glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
-  glUniformMatrix4fv(projLoc, 1, GL_FALSE, &projection[0][0]);
-  glUniform4fv(colorLoc, 1, &color[0]);
-
-  if (aabb.cornerRadius > 0.0f) {
-    int segments = 32;
-    std::vector<glm::vec2> vertices = generateRoundedRectVertices(aabb.size.x, aabb.size.y, aabb.cornerRadius, segments);
-
-    std::vector<unsigned int> indices;
-
-    vertices.insert(vertices.begin(), glm::vec2(0.0f, 0.0f));
+  const std::vector<UIVertex>& vertices = drawList.getVertices();
+  if (vertices.size() > regionCapacity) {
+    size_t capacity = regionCapacity;
+    while (capacity < vertices.size())
+      capacity *= 2;
+    allocateStream(capacity);
+  }
 
-    for (size_t i = 1; i < vertices.size(); i++) {
-      indices.push_back(0);
-      indices.push_back(i);
-      indices.push_back((i % (vertices.size() - 1)) + 1);
+  GLint first = 0;
+  if (streamMapping) {
+    // The region written three flushes ago is the oldest the GPU might still read
+    streamRegion = (streamRegion + 1) % STREAM_REGIONS;
+    GLsync& fence = regionFences[streamRegion];
+    if (fence) {
+      glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+      glDeleteSync(fence);
+      fence = nullptr;
     }
 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2), vertices.data(), GL_DYNAMIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_DYNAMIC_DRAW);
-
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    first = (GLint)(streamRegion * regionCapacity);
+    memcpy(streamMapping + first, vertices.data(), vertices.size() * sizeof(UIVertex));
   } else {
-    float vertices[] = {
-      -aabb.size.x * 0.5f, -aabb.size.y * 0.5f,
-      aabb.size.x * 0.5f, -aabb.size.y * 0.5f,
-      aabb.size.x * 0.5f,  aabb.size.y * 0.5f,
-      -aabb.size.x * 0.5f,  aabb.size.y * 0.5f
-    };
-
-    unsigned int indices[] = {
-      0, 1, 2,
-      2, 3, 0
-    };
-
-    glBindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(regionCapacity * STREAM_REGIONS * sizeof(UIVertex)), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)(vertices.size() * sizeof(UIVertex)), vertices.data());
+  }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_DYNAMIC_DRAW);
+  glUseProgram(shaderProgram);
+  glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, &projection[0][0]);
+  glActiveTexture(GL_TEXTURE0);
+  glBindVertexArray(VAO);
 
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+  unsigned int boundTexture = 0;
+  glBindTexture(GL_TEXTURE_2D, 0);
+  for (const UIDrawCommand& command : drawList.getCommands()) {
+    if (command.texture != boundTexture) {
+      glBindTexture(GL_TEXTURE_2D, command.texture);
+      boundTexture = command.texture;
+    }
+    glDrawArrays(GL_TRIANGLES, first + (GLint)command.first, (GLsizei)command.count);
   }
+
+  glBindVertexArray(0);
+
+  if (streamMapping)
+    regionFences[streamRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  lastDrawCalls = drawList.getCommands().size();
+  lastVertexCount = vertices.size();
+  drawList.clear();
+  glyphAtlas.nextBatch();
 }
 
-void UIRenderer::renderTexturedAABB(const AABB& aabb, unsigned int textureID, const glm::vec4& tintColor, const glm::vec4& colorMult) {
+void UIRenderer::renderAABB(const AABB& aabb, const glm::vec4 color, float borderWidth) {
   if (!initialized) {
     std::cerr << "UIRenderer not initialized!" << std::endl;
     return;
   }
 
-  glUseProgram(textureShaderProgram);
-
-  glm::mat4 model = glm::mat4(1.0f);
-  model = glm::translate(model, glm::vec3(aabb.position, 0.0f));
-
-  int modelLoc = glGetUniformLocation(textureShaderProgram, "model");
-  int projLoc = glGetUniformLocation(textureShaderProgram, "projection");
-  int tintLoc = glGetUniformLocation(textureShaderProgram, "tintColor");
-  int colorMultLoc = glGetUniformLocation(textureShaderProgram, "colorMult");
-
-  glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
-  glUniformMatrix4fv(projLoc, 1, GL_FALSE, &projection[0][0]);
-  glUniform4fv(tintLoc, 1, &tintColor[0]);
-  glUniform4fv(colorMultLoc, 1, &colorMult[0]);
-
-  float vertices[] = {
-    -aabb.size.x * 0.5f, -aabb.size.y * 0.5f,  0.0f, 1.0f,
-     aabb.size.x * 0.5f, -aabb.size.y * 0.5f,  1.0f, 1.0f,
-     aabb.size.x * 0.5f,  aabb.size.y * 0.5f,  1.0f, 0.0f,
-    -aabb.size.x * 0.5f,  aabb.size.y * 0.5f,  0.0f, 0.0f
-  };
-
-  unsigned int indices[] = {
-    0, 1, 2,
-    2, 3, 0
-  };
-
-  unsigned int texVAO, texVBO, texEBO;
-  glGenVertexArrays(1, &texVAO);
-  glGenBuffers(1, &texVBO);
-  glGenBuffers(1, &texEBO);
-
-  glBindVertexArray(texVAO);
-
-  glBindBuffer(GL_ARRAY_BUFFER, texVBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  drawList.addRoundedRect(aabb.position, aabb.size, aabb.cornerRadius, color, borderWidth);
+}
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, texEBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+void UIRenderer::renderFilledAABB(const AABB& aabb, const glm::vec4& color) {
+  if (!initialized) {
+    std::cerr << "UIRenderer not initialized!" << std::endl;
+    return;
+  }
 
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
-  glEnableVertexAttribArray(0);
+  if (aabb.cornerRadius > 0.0f)
+    drawList.addRoundedRect(aabb.position, aabb.size, aabb.cornerRadius, color);
+  else
+    drawList.addQuad(aabb.getMin(), aabb.getMax(), color);
+}
 
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
-  glEnableVertexAttribArray(1);
+void UIRenderer::renderShadow(const AABB& aabb, float softness, const glm::vec4& color) {
+  if (!initialized) {
+    std::cerr << "UIRenderer not initialized!" << std::endl;
+    return;
+  }
 
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, textureID);
-  glUniform1i(glGetUniformLocation(textureShaderProgram, "textureSampler"), 0);
+  drawList.addShadow(aabb.position, aabb.size, aabb.cornerRadius, softness, color);
+}
 
-  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+void UIRenderer::renderTexturedAABB(const AABB& aabb, unsigned int textureID, const glm::vec4& tintColor, const glm::vec4& colorMult,
+                                    const glm::vec2& uvMin, const glm::vec2& uvMax) {
+  if (!initialized) {
+    std::cerr << "UIRenderer not initialized!" << std::endl;
+    return;
+  }
 
-  glBindVertexArray(0);
-  glDeleteVertexArrays(1, &texVAO);
-  glDeleteBuffers(1, &texVBO);
-  glDeleteBuffers(1, &texEBO);
+  drawList.addQuad(aabb.getMin(), aabb.getMax(), tintColor * colorMult, UIDrawList::TEXTURED, textureID, uvMin, uvMax);
 }
 
 unsigned int UIRenderer::loadTexture(const char* filepath) {
@@ -483,11 +506,11 @@ void UIRenderer::deleteTexture(unsigned int textureID) {
 
 void UIRenderer::cleanup() {
   if (initialized) {
+    drawList.clear();
+    releaseStream();
     glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
     glDeleteProgram(shaderProgram);
-    glDeleteProgram(textureShaderProgram);
+    glyphAtlas.cleanup();
     initialized = false;
   }
 }
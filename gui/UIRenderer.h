@@ -4,6 +4,12 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <string>
+#include <vector>
+
+#include "GlyphAtlas.h"
+#include "UIDrawList.h"
+
 struct AABB {
   glm::vec2 position;
   glm::vec2 size;
@@ -26,15 +32,31 @@ struct AABB {
 
 class UIRenderer {
   private:
-    unsigned int VAO, VBO, EBO;
+    unsigned int VAO, VBO;
     unsigned int shaderProgram;
-    unsigned int textureShaderProgram;
+    int projectionLocation;
     bool initialized;
     glm::mat4 projection;
 
+    // Everything drawn is recorded here and submitted by flush()
+    UIDrawList drawList;
+    GlyphAtlas glyphAtlas;
+
+    // VBO is split into regions written round-robin, each fenced until the GPU has drawn from it;
+    // persistently mapped with GL 4.4, orphaned and refilled without
+    static const int STREAM_REGIONS = 3;
+    UIVertex* streamMapping;
+    size_t regionCapacity;
+    int streamRegion;
+    GLsync regionFences[STREAM_REGIONS];
+
+    size_t lastDrawCalls;
+    size_t lastVertexCount;
+
     void compileShader();
-    void compileTextureShader();
     void setupBuffers();
+    void allocateStream(size_t vertexCapacity);
+    void releaseStream();
 
   public:
     UIRenderer();
@@ -43,10 +65,31 @@ class UIRenderer {
     void init();
     void setProjection(const glm::mat4& proj);
     
-    void renderAABB(const AABB& aabb, const glm::vec4 color = glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
+    // Outline borderWidth pixels wide, inside the box
+    void renderAABB(const AABB& aabb, const glm::vec4 color = glm::vec4(0.0f, 1.0f, 0.0f, 1.0f), float borderWidth = 1.0f);
     void renderFilledAABB(const AABB& aabb, const glm::vec4& color = glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
-    void renderTexturedAABB(const AABB& aabb, unsigned int textureID, const glm::vec4& tintColor = glm::vec4(1.0f), const glm::vec4& colorMult = glm::vec4(1.0f));
+    // Soft-edged copy of the box's shape, fading out over softness pixels either side of its edge
+    void renderShadow(const AABB& aabb, float softness, const glm::vec4& color = glm::vec4(0.0f, 0.0f, 0.0f, 0.5f));
+    void renderTexturedAABB(const AABB& aabb, unsigned int textureID, const glm::vec4& tintColor = glm::vec4(1.0f), const glm::vec4& colorMult = glm::vec4(1.0f),
+                            const glm::vec2& uvMin = glm::vec2(0.0f), const glm::vec2& uvMax = glm::vec2(1.0f));
     
+    // fontPath nullptr tries assets/font.ttf, then common system monospace fonts
+    bool initText(const char* fontPath, int pixelSize);
+    bool hasText() const { return glyphAtlas.isReady(); }
+    const GlyphAtlas& getGlyphAtlas() const { return glyphAtlas; }
+
+    // position is the start of the baseline; text is UTF-8, '\n' starts a new line
+    void renderText(const std::string& text, const glm::vec2& position, const glm::vec4& color = glm::vec4(1.0f));
+    glm::vec2 measureText(const std::string& text);
+    float getLineHeight() const { return glyphAtlas.getLineHeight(); }
+
+    // Draws everything recorded since the last flush; once a frame, before presenting
+    void flush();
+
+    // Of the last flush
+    size_t getLastDrawCalls() const { return lastDrawCalls; }
+    size_t getLastVertexCount() const { return lastVertexCount; }
+
     static unsigned int loadTexture(const char* filepath);
     static void deleteTexture(unsigned int textureID);
     
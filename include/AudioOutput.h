@@ -0,0 +1,60 @@
+#ifndef AUDIOOUTPUT_H
+#define AUDIOOUTPUT_H
+
+#include <miniaudio/miniaudio.h>
+
+#include <atomic>
+#include <cstdint>
+
+class AudioReader;
+
+// The playback device, outliving the readers that feed it. The callback pulls
+// from the current reader; once that one has played out to the end of its
+// stream it carries on from the queued next reader within the same callback,
+// so consecutive items play without a gap.
+class AudioOutput
+{
+public:
+    AudioOutput();
+    ~AudioOutput();
+
+    bool Open(int sampleRate, int channels);
+    // No device: nothing plays until samples are pulled with Render
+    bool OpenHeadless(int sampleRate, int channels);
+    void Close();
+    bool IsOpen() const { return deviceInitialized || headless; }
+
+    // What the device callback does, for a headless output's caller. Always fills frameCount
+    // frames, padding with silence; returns how many came from the source
+    uint32_t Render(float* samples, uint32_t frameCount);
+
+    bool Start();
+    void Stop();
+
+    void SetSource(AudioReader* reader);
+    AudioReader* GetSource() const { return current.load(); }
+
+    // Takes over from the current reader when it drains; nullptr cancels
+    void QueueNext(AudioReader* reader) { next.store(reader); }
+    AudioReader* GetQueued() const { return next.load(); }
+
+    void SetVolume(float volume);
+
+    int GetSampleRate() const { return sampleRate; }
+    int GetChannels() const { return channels; }
+    double GetLatency() const;
+
+private:
+    static void Callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+
+    ma_device device;
+    bool deviceInitialized = false;
+    bool headless = false;
+    int sampleRate = 48000;
+    int channels = 2;
+
+    std::atomic<AudioReader*> current{ nullptr };
+    std::atomic<AudioReader*> next{ nullptr };
+};
+
+#endif
@@ -1,8 +1,6 @@
 #ifndef AUDIOREADER_H
 #define AUDIOREADER_H
 
-#include <miniaudio/miniaudio.h>
-
 extern "C"
 {
 #include <libavcodec/avcodec.h>
@@ -12,63 +10,144 @@ extern "C"
 }
 
 #include <vector>
+#include <atomic>
+#include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <cstring>
 
+#include "MediaSource.h"
+#include "RingBuffer.h"
+#include "TimeStretcher.h"
+#include "AudioOutput.h"
+
+struct AudioDecodeStats
+{
+    uint64_t samplesDecoded = 0;    // per channel, at the stream's rate
+    double decodeSeconds = 0.0;     // inside libavcodec
+    double resampleSeconds = 0.0;   // swr_convert and time-stretching
+};
+
 class AudioReader
 {
 public:
     AudioReader();
     ~AudioReader();
 
-    bool Open(const char* filename);
+    // Opens the output at this stream's rate if nobody has yet; otherwise converts to its format.
+    // Reopening keeps the decoder context when the codec parameters are unchanged.
+    // On failure the source stops queueing audio nobody would read.
+    bool Open(MediaSource* source, AudioOutput* output);
     void Close();
     
-    bool PrefillBuffer();
+    // Decodes ahead before playback: a few frames, or the given number of seconds
+    bool PrefillBuffer(double seconds = 0.0);
+
+    // Refills the ring on a worker woken by the callback at the low watermark
+    void StartDecoding();
+    void StopDecoding();
     
+    // Makes this the output's source and starts the device
     bool Play();
     void Pause();
     void Stop();
     bool IsPlaying() const { return isPlaying; }
+    bool IsFinished() const { return endOfStream && audioBuffer.AvailableRead() == 0; }
+
+    // Device side, called from AudioOutput's callback: copies out up to frameCount frames
+    size_t Render(float* samples, size_t frameCount);
+    void Activate();
+    void Deactivate() { isPlaying = false; }
     
+    // Tempo change with pitch kept. Applies to audio decoded from now on, so set it with
+    // decoding stopped and follow with Seek to drop what is buffered at the old rate.
+    void SetPlaybackRate(double rate);
+    double GetPlaybackRate() const { return playbackRate; }
+
+    // Call after MediaSource::Seek: flushes the decoder and drops audio before targetTime
     bool Seek(double targetTime);
+
+    // Pts of the last decoded frame, ahead of what is audible by the ring and device buffering
     double GetCurrentTime() const;
+
+    // Master clock: media time being heard now. Built from the frames the callback has
+    // consumed less the device's buffering, interpolated between callbacks on a
+    // monotonic clock and slewed toward each new reading. Render thread only.
+    double GetClock();
+    double GetDeviceLatency() const;
     double GetDuration() const { return duration; }
-    
-    ma_device& GetDevice() { return device; }
 
+    // Decoded audio in the ring, not yet taken by the device
+    double GetBufferedSeconds() const { return (double)audioBuffer.AvailableRead() / (channels * sizeof(float)) / sampleRate; }
+
+    AudioDecodeStats GetDecodeStats() const;
+    
     void SetMasterTime(double time);
     double GetAudioLatency() const;
-    
-    void FillBuffer();
 
 private:
-    static void AudioCallback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+    void Detach();
+    bool OpenStream(MediaSource* source, AudioOutput* output);
     bool ReadAndDecodeAudioFrame();
+    bool FlushPendingAudio();
+    void FillBuffer();
+    void DecodeLoop();
     
-    AVFormatContext* avFormatCTX = nullptr;
+    MediaSource* mediaSource = nullptr;
+    PacketQueue* packetQueue = nullptr;
     AVCodecContext* avCodecCTX = nullptr;
     AVFrame* avFrame = nullptr;
     AVPacket* avPacket = nullptr;
     SwrContext* swrContext = nullptr;
+    AVCodecParameters* openedParams = nullptr;
     
-    ma_device device;
-    ma_device_config deviceConfig;
+    AudioOutput* output = nullptr;
     
     int audioStreamIndex = -1;
     double duration = 0.0;
     AVRational timeBase;
     
-    std::vector<uint8_t> audioBuffer;
-    size_t bufferReadPos = 0;
-    size_t bufferWritePos = 0;
-    std::mutex bufferMutex;
+    RingBuffer audioBuffer;
+    std::vector<uint8_t> pendingAudio;
+    size_t pendingOffset = 0;
+
+    TimeStretcher stretcher;
+    std::vector<float> stretched;
+    double playbackRate = 1.0;
+    
+    std::thread decodeThread;
+    std::mutex decodeMutex;
+    std::condition_variable refillCond;
+    std::atomic<bool> decoding{ false };
+    std::atomic<bool> refillRequested{ false };
+    std::atomic<bool> endOfStream{ false };
+    size_t lowWatermark = 0;
     
-    bool isPlaying = false;
+    std::atomic<bool> isPlaying{ false };
     bool isPrefilling = false;
-    bool deviceInitialized = false;
     
+    std::atomic<uint64_t> samplesDecoded{ 0 };
+    std::atomic<int64_t> decodeNanoseconds{ 0 };
+    std::atomic<int64_t> resampleNanoseconds{ 0 };
+
     double currentPts = 0.0;
+    double skipUntil = -1.0;
+
+    // Written by the callback under a sequence lock: frames consumed and when
+    std::atomic<uint32_t> clockSequence{ 0 };
+    std::atomic<uint64_t> framesConsumed{ 0 };
+    std::atomic<int64_t> callbackTime{ 0 };
+    std::atomic<uint32_t> callbackFrames{ 0 };
+
+    // Media time of the first sample in the ring since open or the last seek
+    std::atomic<double> clockBase{ 0.0 };
+    std::atomic<bool> clockBaseSet{ false };
+
+    double smoothedClock = 0.0;
+    bool clockValid = false;
+    std::chrono::steady_clock::time_point lastClockQuery;
+
     double masterTime = 0.0;
     
     int sampleRate = 48000;
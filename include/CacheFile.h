@@ -0,0 +1,17 @@
+#ifndef CACHEFILE_H
+#define CACHEFILE_H
+
+#include <string>
+#include <cstdint>
+
+// Per-user cache for data derived from media files ($XDG_CACHE_HOME/video-app,
+// falling back to ~/.cache/video-app). Entries are named after a hash of the
+// media file's absolute path and validated against its size and mtime.
+class CacheFile
+{
+public:
+    static std::string PathFor(const char* mediaPath, const char* extension);
+    static bool GetFileStamp(const char* path, int64_t* size, int64_t* mtime);
+};
+
+#endif
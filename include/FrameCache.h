@@ -0,0 +1,56 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+extern "C"
+{
+#include <libavutil/imgutils.h>
+}
+
+#include <map>
+#include <vector>
+#include <cstdint>
+
+#include "FrameQueue.h"
+
+// Decoded frames around the stepping position, keyed by pts and packed
+// tightly in their native YUV layout. Stepping back through a GOP then costs
+// a texture upload per frame instead of a decode from the keyframe. Frames
+// farthest from the one just stored are evicted to stay within the budget.
+class FrameCache
+{
+public:
+    FrameCache();
+
+    void Init(size_t budgetBytes);
+    void Clear();
+
+    void Store(const VideoFrame& frame);
+
+    // The cached frame directly before or after time (direction -1 or +1), if it is at
+    // most maxGap away; its planes stay valid until the next Store or Clear
+    bool FindAdjacent(double time, int direction, double maxGap, VideoFrame* frame) const;
+
+    size_t GetSize() const { return usedBytes; }
+
+private:
+    struct Entry
+    {
+        std::vector<uint8_t> data;
+        AVPixelFormat format;
+        AVColorSpace colorspace;
+        AVColorRange colorRange;
+        int width;
+        int height;
+        double time;
+    };
+
+    void Evict(int64_t keep);
+    static void Describe(const Entry& entry, int64_t pts, VideoFrame* frame);
+
+    std::map<int64_t, Entry> entries;
+    std::vector<std::vector<uint8_t>> spare;
+    size_t budget = 0;
+    size_t usedBytes = 0;
+};
+
+#endif
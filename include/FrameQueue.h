@@ -0,0 +1,88 @@
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/buffer.h>
+#include <libavutil/pixfmt.h>
+}
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// Decoded picture in its native YUV layout. frame holds a reference to the
+// decoder's AVFrame, so consumers can av_frame_ref it instead of copying.
+// The planes point at that frame's own buffers when it can be uploaded as is,
+// at a pooled conversion buffer (converted), or at data: a slot of the
+// renderer's mapped upload buffer, bufferOffset being its offset there.
+// RGB conversion happens in the shader.
+struct VideoFrame
+{
+    AVFrame* frame = nullptr;
+    AVBufferRef* converted = nullptr;
+    uint8_t* data = nullptr;
+    size_t bufferOffset = SIZE_MAX;
+    uint8_t* planes[4] = {};
+    int linesizes[4] = {};
+
+    AVPixelFormat format = AV_PIX_FMT_NONE;
+    AVColorSpace colorspace = AVCOL_SPC_UNSPECIFIED;
+    AVColorRange colorRange = AVCOL_RANGE_UNSPECIFIED;
+    int width = 0;
+    int height = 0;
+
+    int64_t pts = 0;
+    double time = 0.0;
+};
+
+// Fixed ring of presentation-ready frames between the video decode thread
+// and the render loop. Slots are allocated once, so steady-state decoding
+// only writes into memory it already owns. A popped frame stays in flight,
+// unavailable to the producer, until Release() says the GPU is done with it.
+// A discarded frame never reaches the GPU, so it is freed as soon as every
+// frame popped before it has been released.
+class FrameQueue
+{
+public:
+    FrameQueue();
+    ~FrameQueue();
+
+    // Converted or staged pixels go to storage (depth * frameSize bytes) when given
+    void Init(size_t depth, size_t frameSize, uint8_t* storage = nullptr);
+
+    // Producer side: blocks while every slot is in use
+    VideoFrame* PeekWritable();
+    void Push();
+
+    // Consumer side: never blocks, returns nullptr when fewer than offset + 1 frames are decoded
+    VideoFrame* PeekReadable(size_t offset = 0);
+    void Pop();
+    void Discard();
+    void Release();
+
+    void Flush();
+    void Abort(bool abort);
+
+    size_t Size() const;
+    size_t Depth() const { return frames.size(); }
+
+private:
+    void FreeFrames();
+    void ReleaseDiscarded();
+
+    std::vector<VideoFrame> frames;
+    std::vector<bool> discarded;
+    size_t readIndex = 0;
+    size_t writeIndex = 0;
+    size_t count = 0;
+    size_t inFlight = 0;
+    bool aborted = false;
+
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef KEYFRAMEINDEX_H
+#define KEYFRAMEINDEX_H
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+// Keyframe positions of one video stream, so seeks can land on the right GOP
+// without relying on the container's own index. Built on a background thread
+// with a private demuxer the first time a file is opened, then persisted to a
+// memory-mapped cache file keyed by the file's size and mtime.
+class KeyframeIndex
+{
+public:
+    struct Entry
+    {
+        int64_t pts;            // stream time base
+        int64_t position;       // byte offset of the keyframe packet, -1 if unknown
+        int64_t frameNumber;    // video packets preceding it
+    };
+
+    KeyframeIndex();
+    ~KeyframeIndex();
+
+    // Maps the cached index if it is still valid, otherwise starts building it
+    void Open(const char* filename, int streamIndex);
+    void Close();
+
+    bool IsReady() const { return ready; }
+
+    // Last keyframe at or before pts, nullptr if none or not ready; O(log n)
+    const Entry* Find(int64_t pts) const;
+
+    int64_t GetFrameCount() const { return ready ? frameCount : -1; }
+
+private:
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        int64_t fileSize;
+        int64_t modifiedTime;
+        int64_t streamIndex;
+        int64_t frameCount;
+        int64_t entryCount;
+    };
+
+    bool Load();
+    void Build();
+    void Save();
+
+    std::string mediaPath;
+    std::string cachePath;
+    int streamIndex = -1;
+    int64_t fileSize = 0;
+    int64_t modifiedTime = 0;
+
+    std::vector<Entry> builtEntries;
+    const Entry* entries = nullptr;
+    size_t entryCount = 0;
+    int64_t frameCount = 0;
+
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+
+    std::thread buildThread;
+    std::atomic<bool> building{ false };
+    std::atomic<bool> ready{ false };
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+// A local media file mapped read-only into memory. Every reader of the same
+// unchanged file shares one mapping, so the demuxer, the keyframe index
+// builder and the thumbnail decoder all read the same pages.
+// The mapping only covers the file as it was at open. Copy catches the SIGBUS
+// of pages a later truncation took away; readers that hit it, or find the
+// size changed when they look, switch to ReadAt for the file as it is now.
+class MappedFile
+{
+public:
+    // Files modified more recently than this are probably still being written and are not mapped
+    static const int RecentWriteSeconds = 5;
+
+    ~MappedFile();
+
+    // Existing mapping of the file if there is one, nullptr for anything that cannot be mapped
+    static std::shared_ptr<MappedFile> Open(const char* path);
+
+    // memcpy out of the mapping; false, with nothing usable copied, if the range is no longer backed by the file
+    bool Copy(uint8_t* buffer, int64_t offset, int size) const;
+
+    // Same size and modification time as when it was mapped; one fstat
+    bool IsUnchanged() const;
+    // The file as it is now, through pread: byte count, 0 at the end, or a negative errno
+    int ReadAt(uint8_t* buffer, int64_t offset, int size) const;
+    int64_t GetCurrentSize() const;
+
+    const uint8_t* GetData() const { return data; }
+    int64_t GetSize() const { return size; }
+
+    // Asks the kernel to start reading [offset, offset + length) in
+    void Prefetch(int64_t offset, int64_t length) const;
+
+private:
+    MappedFile() {}
+
+    std::string key;
+    int fd = -1;
+    const uint8_t* data = nullptr;
+    int64_t size = 0;
+    int64_t modifiedTime = 0;   // nanoseconds
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef MAPPEDINPUT_H
+#define MAPPEDINPUT_H
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+}
+
+#include <memory>
+
+#include "MappedFile.h"
+
+// AVIOContext reading straight out of a MappedFile: a memcpy per read instead
+// of a read() syscall, with the kernel asked to fetch ahead of the position.
+// Once the file is found truncated or grown, reads go through pread for the rest of the session.
+class MappedInput
+{
+public:
+    // How far ahead of the read position pages are requested
+    static const int64_t ReadAheadBytes = 8 * 1024 * 1024;
+
+    MappedInput();
+    ~MappedInput();
+
+    // Attaches to an AVFormatContext not yet opened; false leaves it on FFmpeg's own file I/O
+    bool Attach(AVFormatContext* formatCTX, const char* filename);
+
+    // Call after avformat_close_input, which leaves custom I/O to its owner
+    void Close();
+
+    // Seek target hint, for a byte position known before the demuxer gets there
+    void Prefetch(int64_t offset);
+
+private:
+    static int Read(void* opaque, uint8_t* buffer, int size);
+    static int64_t Seek(void* opaque, int64_t offset, int whence);
+
+    // Rechecks the file against the mapping; for the end of the file only, as it costs an fstat
+    int64_t CurrentSize();
+
+    std::shared_ptr<MappedFile> file;
+    AVIOContext* ioCTX = nullptr;
+    int64_t position = 0;
+    int64_t prefetchedUntil = 0;
+    bool fileChanged = false;
+};
+
+#endif
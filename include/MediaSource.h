@@ -0,0 +1,113 @@
+#ifndef MEDIASOURCE_H
+#define MEDIASOURCE_H
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+}
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "PacketQueue.h"
+#include "KeyframeIndex.h"
+#include "MappedInput.h"
+#include "ReadAheadInput.h"
+
+class ProbeCache;
+
+struct DemuxStats
+{
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    double readSeconds = 0.0;   // demux thread time inside av_read_frame
+};
+
+// Owns the one AVFormatContext of an opened file. A demux thread reads it and
+// routes packets into per-stream queues consumed by VideoReader and AudioReader.
+class MediaSource
+{
+public:
+    MediaSource();
+    ~MediaSource();
+
+    // Applies from the next Open
+    void SetReadAhead(const ReadAheadOptions& options) { readAheadOptions = options; }
+
+    bool Open(const char* filename);
+    void Close();
+
+    void Start();
+    void Stop();
+
+    bool Seek(double targetTime);
+
+    AVFormatContext* GetFormatContext() const { return avFormatCTX; }
+
+    int GetVideoStreamIndex() const { return videoStreamIndex; }
+    int GetAudioStreamIndex() const { return audioStreamIndex; }
+
+    // Stops selecting and queueing the audio stream, for when nothing will decode it; call before Start
+    void DisableAudio();
+
+    PacketQueue* GetVideoQueue() { return videoStreamIndex >= 0 ? &videoQueue : nullptr; }
+    PacketQueue* GetAudioQueue() { return audioStreamIndex >= 0 ? &audioQueue : nullptr; }
+
+    const KeyframeIndex& GetKeyframeIndex() const { return keyframeIndex; }
+
+    // Time Open spent opening and probing, and whether a cached probe result shortened it
+    double GetProbeSeconds() const { return probeSeconds; }
+    bool WasProbeCached() const { return probeCached; }
+
+    DemuxStats GetDemuxStats() const;
+
+    bool UsesReadAhead() const { return readAheadInput.IsAttached(); }
+    ReadAheadStats GetReadAheadStats() const { return readAheadInput.GetStats(); }
+
+    // True when a decoder opened for a could decode b without being reopened
+    static bool SameCodecParameters(const AVCodecParameters* a, const AVCodecParameters* b);
+
+private:
+    void DemuxLoop();
+    bool QueuesFull() const;
+    void FlushQueues();
+    bool SeekDemuxer(double targetTime);
+    bool OpenInput(const char* filename, const ProbeCache* probeCache);
+
+    AVFormatContext* avFormatCTX = nullptr;
+    AVPacket* avPacket = nullptr;
+    MappedInput mappedInput;
+    ReadAheadInput readAheadInput;
+    ReadAheadOptions readAheadOptions;
+
+    int videoStreamIndex = -1;
+    int audioStreamIndex = -1;
+
+    PacketQueue videoQueue;
+    PacketQueue audioQueue;
+
+    KeyframeIndex keyframeIndex;
+
+    std::thread demuxThread;
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    bool running = false;
+    bool endOfFile = false;
+    bool seekRequested = false;
+    bool seekSucceeded = false;
+    double seekTarget = 0.0;
+
+    std::atomic<uint64_t> packetsRead{ 0 };
+    std::atomic<uint64_t> bytesRead{ 0 };
+    std::atomic<int64_t> readNanoseconds{ 0 };
+
+    bool probeCached = false;
+    double probeSeconds = 0.0;
+};
+
+#endif
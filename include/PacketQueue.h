@@ -0,0 +1,55 @@
+#ifndef PACKETQUEUE_H
+#define PACKETQUEUE_H
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Packets of a single stream, filled by the MediaSource demux thread and
+// drained by one reader. The capacity is soft: the demuxer only stops reading
+// once every queue it feeds is full, so a starving stream can never deadlock
+// behind a full one. Past the hard limits it stops regardless, so a stream
+// nobody drains cannot pull the rest of the file into memory.
+class PacketQueue
+{
+public:
+    // Hard limits, as multiples of the capacity and in packet payload bytes
+    static const size_t HardLimitFactor = 4;
+    static const size_t HardLimitBytes = 128 * 1024 * 1024;
+
+    PacketQueue(size_t capacity = 256);
+    ~PacketQueue();
+
+    void Push(AVPacket* packet);
+    bool Pop(AVPacket* packet);
+
+    void Flush();
+    void SetEOF(bool eof);
+    void Abort(bool abort);
+
+    // The demuxer has finished the stream and every packet has been popped
+    bool IsEndOfStream() const;
+    bool IsFull() const;
+    bool IsOverLimit() const;
+    size_t Size() const;
+
+    std::function<void()> onDrain;
+
+private:
+    std::deque<AVPacket*> packets;
+    size_t capacity;
+    size_t bytes = 0;
+    bool endOfStream = false;
+    bool aborted = false;
+
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+};
+
+#endif
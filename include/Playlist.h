@@ -0,0 +1,93 @@
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "MediaSource.h"
+#include "VideoReader.h"
+#include "AudioReader.h"
+#include "AudioOutput.h"
+#include "ThumbnailCache.h"
+
+// How an item is opened and started; shared by every item of a playlist
+struct PlaybackSettings
+{
+    VideoDecodeOptions decodeOptions;
+    double playbackRate = 1.0;
+    double refreshInterval = 1.0 / 60.0;
+    double audioPrefillSeconds = 0.0;   // 0 decodes a few frames
+    ReadAheadOptions readAhead;
+
+    // Renderer upload buffer to decode into, when no other item is using it
+    uint8_t* frameStorage = nullptr;
+    size_t storageSlots = 0;
+    size_t storageFrameSize = 0;
+};
+
+// Everything one file needs to play. Items are reopened rather than rebuilt,
+// so decoder contexts carry over between files in the same format.
+class PlaylistItem
+{
+public:
+    PlaylistItem();
+    ~PlaylistItem();
+
+    // Probes the file and opens the decoders; nothing runs yet
+    bool Open(const std::string& path, AudioOutput* output, const PlaybackSettings& settings);
+
+    // Starts demuxing and decoding, waiting for the first frame and the audio prefill
+    void Start(const PlaybackSettings& settings);
+
+    // Open and Start on a worker, so the current item keeps playing meanwhile
+    void Prepare(const std::string& path, AudioOutput* output, const PlaybackSettings& settings);
+    bool IsPreparing() const { return preparing; }
+    bool IsReady() const { return ready; }
+    bool UsesFrameStorage() const { return usesFrameStorage; }
+    double GetPlaybackRate() const { return playbackRate; }
+
+    // From the start of Open until Start had the first frame decoded
+    double GetFirstFrameSeconds() const { return firstFrameSeconds; }
+    void PrintOpenTiming() const;
+
+    // Stops every thread but keeps the decoders for the next Open
+    void Stop();
+    void Close();
+
+    MediaSource source;
+    VideoReader video;
+    AudioReader audio;
+    ThumbnailCache thumbnails;
+    bool hasAudio = false;
+    std::string path;
+
+private:
+    void WaitPrepared();
+
+    bool usesFrameStorage = false;
+    double playbackRate = 1.0;
+    double firstFrameSeconds = 0.0;
+    std::chrono::steady_clock::time_point openStart;
+    std::thread prepareThread;
+    std::atomic<bool> preparing{ false };
+    std::atomic<bool> ready{ false };
+};
+
+// Files to play in order, from the command line and any M3U lists on it
+class Playlist
+{
+public:
+    void Add(const std::string& path);
+    size_t Size() const { return paths.size(); }
+    const std::string& Get(size_t index) const { return paths[index]; }
+
+private:
+    void AddM3U(const std::string& path);
+
+    std::vector<std::string> paths;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef PROBECACHE_H
+#define PROBECACHE_H
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Stream parameters of a file as avformat_find_stream_info left them, kept in
+// the per-user cache and keyed by the file's size and mtime. With an entry on
+// hand a reopen only needs a short probe; whatever that probe did not get to
+// is filled in from the entry.
+class ProbeCache
+{
+public:
+    // Limits for avformat_find_stream_info once an entry was loaded
+    static const int64_t ShortProbeSize = 64 * 1024;
+    static const int64_t ShortAnalyzeDuration = 100000;    // AV_TIME_BASE units
+
+    // False if there is no entry or the file changed since it was written
+    bool Load(const char* filename);
+    bool IsLoaded() const { return loaded; }
+
+    // Demuxer the file was detected with, so format probing is skipped too
+    const AVInputFormat* GetInputFormat() const;
+
+    // Fills parameters the short probe left unset; false if the streams do not match the entry
+    bool Apply(AVFormatContext* formatCTX) const;
+
+    void Save(const char* filename, const AVFormatContext* formatCTX);
+
+private:
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        int64_t fileSize;
+        int64_t modifiedTime;
+        char formatName[32];
+        int64_t startTime;
+        int64_t duration;
+        int64_t streamCount;
+    };
+
+    struct StreamRecord
+    {
+        int32_t codecType;
+        int32_t codecId;
+        uint32_t codecTag;
+        int32_t format;
+        int32_t profile;
+        int32_t level;
+        int32_t width;
+        int32_t height;
+        AVRational sampleAspectRatio;
+        int32_t sampleRate;
+        int32_t channels;
+        uint64_t channelMask;       // 0 when the layout was not a native one
+        int32_t frameSize;
+        AVRational timeBase;
+        AVRational averageFrameRate;
+        AVRational realFrameRate;
+        int64_t startTime;
+        int64_t duration;
+        int64_t frameCount;
+        int64_t extradataSize;      // bytes following the record
+    };
+
+    Header header = {};
+    std::vector<StreamRecord> streams;
+    std::vector<std::vector<uint8_t>> extradata;
+    bool loaded = false;
+};
+
+#endif
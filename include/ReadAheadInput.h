@@ -0,0 +1,142 @@
+#ifndef READAHEADINPUT_H
+#define READAHEADINPUT_H
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+}
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+struct io_uring_sqe;
+
+enum ReadAheadMode
+{
+    ReadAheadOff = 0,
+    ReadAheadAuto,      // only for files on network filesystems
+    ReadAheadOn,
+};
+
+struct ReadAheadOptions
+{
+    int mode = ReadAheadAuto;
+    int64_t windowBytes = 64 * 1024 * 1024;
+    double windowSeconds = 0.0;     // > 0 sizes the window from the stream bitrate instead
+};
+
+struct ReadAheadStats
+{
+    bool usingIoUring = false;
+    int64_t windowBytes = 0;
+    uint64_t hits = 0;          // reads served from a block already in memory
+    uint64_t stalls = 0;        // reads that waited for a block still in flight
+    uint64_t misses = 0;        // reads outside the window, done synchronously
+    double stallSeconds = 0.0;  // demuxer time spent waiting in stalls and misses
+    uint64_t bytesRead = 0;
+    uint64_t cancelled = 0;     // requests dropped by seeks
+};
+
+// AVIOContext that keeps a window of the file ahead of the demuxer's position
+// requested asynchronously, so av_read_frame only blocks when storage falls
+// behind. Requests go through io_uring, or a few pread threads where the
+// kernel or sandbox refuses it. A seek outside the window cancels what is in
+// flight and starts a new window at the target.
+class ReadAheadInput
+{
+public:
+    static const int64_t BlockSize = 1024 * 1024;
+
+    ReadAheadInput();
+    ~ReadAheadInput();
+
+    // Whether options call for read-ahead on this file
+    static bool Wanted(const char* filename, const ReadAheadOptions& options);
+
+    // Attaches to an AVFormatContext not yet opened; false leaves it on FFmpeg's own file I/O
+    bool Attach(AVFormatContext* formatCTX, const char* filename, const ReadAheadOptions& options);
+    bool IsAttached() const { return ioCTX != nullptr; }
+
+    // Call after avformat_close_input, which leaves custom I/O to its owner
+    void Close();
+
+    // Window from the options' seconds at bitRate (bits per second), once the streams are known
+    void SizeWindow(int64_t bitRate);
+
+    ReadAheadStats GetStats() const;
+
+private:
+    struct Block
+    {
+        int64_t number = 0;
+        int64_t length = 0;
+        std::vector<uint8_t> data;
+        bool inFlight = false;
+        bool cancelled = false;
+        bool failed = false;
+    };
+
+    static int Read(void* opaque, uint8_t* buffer, int size);
+    static int64_t Seek(void* opaque, int64_t offset, int whence);
+
+    void Refill();
+    void Submit(Block* block);
+    void Cancel(Block* block);
+    void Complete(Block* block, int64_t result, bool refill = true);
+    void Recycle(Block* block);
+
+    bool StartRing();
+    void StopRing();
+    int PushRing(const io_uring_sqe& entry);
+    int SubmitRing(Block* block);
+    void CancelRing(Block* block);
+    void ReapLoop();
+    void WorkerLoop();
+
+    ReadAheadOptions options;
+    AVIOContext* ioCTX = nullptr;
+    int fd = -1;
+    int64_t fileSize = 0;
+    int64_t position = 0;
+    int64_t refilledAt = -1;
+    int64_t windowBytes = 0;
+
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+    std::map<int64_t, Block*> blocks;
+    std::vector<Block*> spareBlocks;
+    size_t inFlight = 0;
+    ReadAheadStats stats;
+
+    // io_uring, driven through the raw syscalls so no extra library is needed
+    bool usingRing = false;
+    int ringFd = -1;
+    void* sqMapping = nullptr;
+    size_t sqMappingSize = 0;
+    void* cqMapping = nullptr;
+    size_t cqMappingSize = 0;
+    void* sqeMapping = nullptr;
+    size_t sqeMappingSize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    void* cqes = nullptr;
+    std::thread reapThread;
+
+    // Thread-pool fallback
+    std::vector<std::thread> workers;
+    std::deque<Block*> queued;
+    bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Wait-free single-producer/single-consumer byte ring. The capacity is rounded
+// up to a power of two so positions wrap with a mask, and the read/write
+// counters grow monotonically so full and empty are never ambiguous.
+class RingBuffer
+{
+public:
+    RingBuffer();
+
+    void Init(size_t capacity);
+
+    // Producer thread only
+    size_t Write(const uint8_t* data, size_t size);
+
+    // Consumer thread only
+    size_t Read(uint8_t* data, size_t size);
+
+    size_t AvailableRead() const;
+    size_t AvailableWrite() const;
+    size_t Capacity() const { return buffer.size(); }
+
+    // Only safe while neither side is running
+    void Reset();
+
+private:
+    std::vector<uint8_t> buffer;
+    size_t mask = 0;
+
+    alignas(64) std::atomic<size_t> readPos{ 0 };
+    alignas(64) std::atomic<size_t> writePos{ 0 };
+};
+
+#endif
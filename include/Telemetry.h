@@ -0,0 +1,58 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Timing and sync instrumentation for the playback pipeline. Each thread
+// records into its own ring of fixed-size events and its own histograms, with
+// no locks on the recording path; everything is read once the recording
+// threads have stopped, as a Chrome trace (chrome://tracing, Perfetto) and a
+// p50/p99/max summary. Event names are kept by pointer, so pass literals.
+class Telemetry
+{
+public:
+    // Trace events kept per thread; older ones are overwritten, the histograms keep counting
+    static const size_t DefaultEventsPerThread = 64 * 1024;
+
+    // Recording stays a single relaxed load until this is called
+    static void Enable(size_t eventsPerThread = DefaultEventsPerThread);
+    static bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // Lane name for the calling thread; a restarted thread under the same name continues its lane
+    static void SetThreadName(const char* name);
+
+    // Span start for End, 0 while disabled
+    static int64_t Begin() { return IsEnabled() ? Now() : 0; }
+    static void End(const char* name, int64_t start);
+
+    // A sample of a signed quantity such as drift, in the caller's unit; histograms use its magnitude
+    static void Value(const char* name, double value);
+
+    // A point event such as an underrun or a dropped frame
+    static void Mark(const char* name);
+
+    // Both only once the recording threads have stopped
+    static bool WriteTrace(const char* path);
+    static void PrintSummary();
+
+private:
+    static int64_t Now();
+
+    static std::atomic<bool> enabled;
+};
+
+// Span covering the enclosing block
+class TelemetryScope
+{
+public:
+    explicit TelemetryScope(const char* name) : name(name), start(Telemetry::Begin()) {}
+    ~TelemetryScope() { Telemetry::End(name, start); }
+
+private:
+    const char* name;
+    int64_t start;
+};
+
+#endif
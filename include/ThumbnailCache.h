@@ -0,0 +1,71 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <glm/glm.hpp>
+
+#include "MappedInput.h"
+
+// Timeline preview tiles decoded by a private demuxer and decoder, so filling
+// the cache never touches playback state. Only keyframes are decoded, at the
+// codec's lowres level where available, and scaled to small RGBA tiles that
+// are packed into one atlas texture.
+class ThumbnailCache
+{
+public:
+    ThumbnailCache();
+    ~ThumbnailCache();
+
+    bool Open(const char* filename, int tileCount = 128, int tileWidth = 160);
+    void Close();
+
+    // Render thread: creates the atlas and uploads tiles finished since the last call
+    void UpdateAtlas();
+
+    // O(1): atlas texture and UV rectangle of the tile covering position (0..1)
+    bool Lookup(float position, unsigned int* texture, glm::vec2* uvMin, glm::vec2* uvMax) const;
+
+    glm::vec2 GetTileSize() const { return glm::vec2(tileWidth, tileHeight); }
+
+private:
+    void FillLoop();
+    bool DecodeTile(int tile, AVPacket* packet, AVFrame* frame);
+
+    AVFormatContext* avFormatCTX = nullptr;
+    MappedInput mappedInput;
+    AVCodecContext* avCodecCTX = nullptr;
+    SwsContext* swsScalerCTX = nullptr;
+    int videoStreamIndex = -1;
+    double duration = 0.0;
+
+    int tileCount = 0;
+    int tileWidth = 0;
+    int tileHeight = 0;
+    int atlasColumns = 16;
+
+    // Tiles written by the fill thread, queued until the render thread uploads them
+    std::vector<uint8_t> tilePixels;
+    std::vector<int> pendingTiles;
+    std::mutex pendingMutex;
+
+    // Render thread only
+    std::vector<bool> tileReady;
+
+    unsigned int atlasTexture = 0;
+
+    std::thread fillThread;
+    std::atomic<bool> filling{ false };
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef TIMESTRETCHER_H
+#define TIMESTRETCHER_H
+
+#include <vector>
+#include <cstddef>
+
+// WSOLA time-stretcher for interleaved float audio. Windows of input are
+// taken every hop * rate frames, each shifted within a small search range to
+// the offset that best continues the previous window, and overlap-added every
+// hop frames, so tempo changes while pitch does not.
+class TimeStretcher
+{
+public:
+    TimeStretcher();
+
+    void Init(int sampleRate, int channels);
+    void SetRate(double rate) { this->rate = rate; }
+    double GetRate() const { return rate; }
+    void Reset();
+
+    // Appends the stretched output available so far; input is kept until it has been used
+    void Process(const float* samples, size_t frameCount, std::vector<float>& output);
+
+private:
+    size_t FindBestOffset(size_t nominal) const;
+
+    int channels = 2;
+    size_t windowFrames = 0;
+    size_t hopFrames = 0;
+    size_t searchFrames = 0;
+    double rate = 1.0;
+
+    std::vector<float> window;
+    std::vector<float> input;
+    std::vector<float> overlap;
+    std::vector<float> silence;
+    double analysisPosition = 0.0;
+    long continuation = -1;     // where the last window's input would naturally carry on
+};
+
+#endif
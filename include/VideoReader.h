@@ -14,36 +14,178 @@ extern "C"
 #include <libavutil/error.h>
 }
 
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <sys/types.h>
+
+#include "MediaSource.h"
+#include "FrameQueue.h"
+#include "FrameCache.h"
+
+struct VideoDecodeOptions
+{
+    size_t frameQueueDepth = 3;
+    int threadCount = 0;    // 0 picks from core count, codec and resolution
+    int threadType = 0;     // FF_THREAD_FRAME/FF_THREAD_SLICE mask, 0 uses all the codec supports
+    AVPixelFormat outputFormat = AV_PIX_FMT_NONE;   // forced conversion target; NONE keeps what the renderer samples directly
+};
+
+// Decoder shortcuts taken while presentation keeps falling behind
+enum VideoSkipLevel
+{
+    SkipNone = 0,
+    SkipLoopFilter,     // deblocking skipped on every frame
+    SkipNonRef,         // non-reference frames not decoded at all
+};
+
+struct VideoDecodeStats
+{
+    int threadCount = 0;
+    int threadType = 0;
+    uint64_t framesDecoded = 0;
+    double decodeSeconds = 0.0;     // worker time spent inside libavcodec
+    double wallSeconds = 0.0;       // time the worker was running
+    int codecThreads = 0;           // threads libavcodec started for this decoder
+    double codecCpuSeconds = 0.0;   // their CPU time while the worker ran, from /proc/self/task
+    double workerCpuSeconds = 0.0;  // the worker thread's own CPU time, conversion included
+    double scaleSeconds = 0.0;      // sws_scale into another format
+    double copySeconds = 0.0;       // native frames copied into caller storage
+    uint64_t framesScaled = 0;
+    uint64_t framesCopied = 0;
+
+    uint64_t framesDroppedLate = 0;     // decoded but never shown, the clock had passed the next frame
+    uint64_t framesDegraded = 0;        // shown decoded without the loop filter
+    uint64_t framesSkipped = 0;         // non-reference frames left undecoded (packets in minus frames out)
+    uint64_t framesDecimated = 0;       // decoded but not converted, closer together than the display can show at this rate
+    int skipLevel = SkipNone;
+    int skipEscalations = 0;
+    int decodersReused = 0;         // reopens that kept the codec context
+};
+
 class VideoReader
 {
 public:
 	VideoReader();
     ~VideoReader();
 
-    bool Open(const char* filename);
-    bool ReadFrame(uint8_t* frameBuffer, int64_t* pts);
-    bool Seek(double targetTime);
+    // Reopening keeps the decoder context when the codec parameters are unchanged
+    bool Open(MediaSource* source, const VideoDecodeOptions& options = VideoDecodeOptions());
+    bool ReadFrame(VideoFrame* frame);
+
+    // Runs ReadFrame on a worker that keeps up to frameQueueDepth frames decoded ahead
+    void StartDecoding();
+    void StopDecoding();
+
+    // Decode straight into caller-owned memory holding slotCount frames of GetFrameSize() bytes
+    void UseFrameStorage(uint8_t* storage, size_t slotCount);
+    size_t GetFrameSize() const { return frameSize; }
+
+    // Decoded frames waiting for presentation, out of the queue's depth
+    size_t GetQueuedFrames() const { return frameQueue.Size(); }
+    size_t GetQueueDepth() const { return frameQueue.Depth(); }
+
+    VideoFrame* PeekFrame(size_t offset = 0) { return frameQueue.PeekReadable(offset); }
+    void PopFrame() { frameQueue.Pop(); }
+    void ReleaseFrame() { frameQueue.Release(); }
+
+    // Discards the front frame unshown because the clock has already passed it
+    void DropFrame();
+    // Same, for frames stepping has already moved past; not counted as late
+    void DiscardFrame() { frameQueue.Discard(); }
+
+    // Presentation feedback, in seconds behind schedule. Sustained lateness raises
+    // the decoder's skip level one step at a time; a long on-time run lowers it again.
+    void ReportLateness(double lateness);
+
+    // New reference to the decoded picture, valid after the slot is reused; free with av_frame_free
+    static AVFrame* RefFrame(const VideoFrame& frame) { return av_frame_clone(frame.frame); }
+    bool IsFinished() const;
+
+    VideoDecodeStats GetDecodeStats() const;
+
+    // Above 1x, frames that would land within one display refresh of the previous one are
+    // never converted, and once whole non-reference frames would go unseen they are not decoded
+    void SetPlaybackRate(double rate, double refreshInterval);
+
+    // Call after MediaSource::Seek: flushes the decoder and decodes up to targetTime.
+    // With a cache, every frame decoded on the way is stored in it rather than skipped.
+    bool Seek(double targetTime, FrameCache* cache = nullptr);
     void Close();
 
+    AVPixelFormat GetOutputFormat() const { return outputFormat; }
     int GetWidth() const { return width; }
     int GetHeight() const { return height; }
 
     long long totelFrames = -1;
 
+    // Container frame count, replaced by the keyframe index's exact count once it is built
+    long long GetTotalFrames() const;
+
     AVRational GetTimeBase() const { return timeBase; }
+    double GetFrameDuration() const { return frameDuration; }
     double GetDuration() const;
 
 private:
-    AVFormatContext* avFormatCTX = nullptr;
+    MediaSource* mediaSource     = nullptr;
+    PacketQueue* packetQueue     = nullptr;
     AVCodecContext* avCodecCTX   = nullptr;
     AVFrame* avFrame             = nullptr;
     AVPacket* avPacket           = nullptr;
     SwsContext* swsScalerCTX     = nullptr;
+    AVBufferPool* convertPool    = nullptr;
+    AVCodecParameters* openedParams = nullptr;
+
+    void DecodeLoop();
+    bool DecodeFrame();
+    void FlushDecoder();
+    bool ConvertFrame(VideoFrame* frame);
+    static AVPixelFormat ChooseOutputFormat(AVPixelFormat decoderFormat);
+    static void ConfigureThreading(AVCodecContext* codecCTX, const AVCodec* codec, const VideoDecodeOptions& options);
+    double CodecThreadsCpuSeconds() const;
+
+    FrameQueue frameQueue;
+    std::thread decodeThread;
+    std::atomic<bool> decoding{ false };
+    std::atomic<bool> endOfStream{ false };
+
+    std::atomic<uint64_t> framesDecoded{ 0 };
+    std::atomic<uint64_t> framesDroppedLate{ 0 };
+    std::atomic<uint64_t> framesDegraded{ 0 };
+    std::atomic<uint64_t> packetsSkipping{ 0 };
+    std::atomic<uint64_t> framesSkipping{ 0 };
+    std::atomic<int> skipLevel{ SkipNone };
+    std::atomic<uint64_t> framesDecimated{ 0 };
+    std::atomic<double> minFrameSpacing{ 0.0 };
+    std::atomic<bool> skipNonRefForRate{ false };
+    int skipEscalations = 0;
+    int decodersReused = 0;
+    int lateStreak = 0;
+    int onTimeStreak = 0;
+    double frameDuration = 1.0 / 30.0;
+
+    std::atomic<int64_t> decodeNanoseconds{ 0 };
+    std::atomic<int64_t> scaleNanoseconds{ 0 };
+    std::atomic<int64_t> copyNanoseconds{ 0 };
+    std::atomic<uint64_t> framesScaled{ 0 };
+    std::atomic<uint64_t> framesCopied{ 0 };
+    double runSeconds = 0.0;
+    double runCodecCpuSeconds = 0.0;
+    double runCodecCpuStart = 0.0;
+    std::chrono::steady_clock::time_point runStart;
+    std::atomic<int64_t> workerCpuNanoseconds{ 0 };
+    std::vector<pid_t> codecThreadIds;   // created by avcodec_open2
 
     int videoStreamIndex = -1;
 
     int width = 0;
     int height = 0;
+    AVPixelFormat outputFormat = AV_PIX_FMT_YUV420P;
+    size_t frameSize = 0;
+    int64_t prerollSkipBefore = AV_NOPTS_VALUE;
+    bool packetPending = false;     // avPacket was refused with EAGAIN and goes in again once frames are out
+    bool draining = false;          // end of stream was sent; frames come out until AVERROR_EOF
 
     double duration = 0.0;
     AVRational timeBase;
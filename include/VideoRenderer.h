@@ -1,22 +1,68 @@
 #pragma once
 
 #include <iostream>
+#include <deque>
 #include <glad/glad.h>
 
+#include "FrameQueue.h"
+
 class VideoRenderer
 {
 private:
 	GLuint VAO, VBO, EBO;
     GLuint shaderProgram;
-    GLuint videoTexture;
+    GLuint planeTextures[3];
+    int planeCount = 0;
+    bool chromaInterleaved = false;
+
+    float colorMatrix[9];
+    float colorOffset[3];
+
+    int textureWidth = 0;
+    int textureHeight = 0;
+    AVPixelFormat textureFormat = AV_PIX_FMT_NONE;
+
+    GLuint uploadBuffer = 0;
+    uint8_t* uploadMapping = nullptr;
+    std::deque<GLsync> uploadFences;
+    size_t completedClientUploads = 0;
+
+    double uploadMilliseconds = 0.0;
+
+    // GL_TIME_ELAPSED queries, read back once available so timing never stalls the pipeline
+    static const int TimerQueryCount = 4;
+    GLuint timerQueries[TimerQueryCount] = {};
+    int timerNext = 0;
+    int timersPending = 0;
+    bool timerRunning = false;
+    double gpuMilliseconds = 0.0;
 
     GLuint CompileShader(const char* source, GLenum type);
     GLuint CreateShaderProgram();
+    void UpdateColorMatrix(const VideoFrame& frame);
+    void AllocateTextures(const VideoFrame& frame, int chromaWidth, int chromaHeight);
 
 public:
+    static const size_t MaxUploadsInFlight = 2;
+
     VideoRenderer();
     ~VideoRenderer();
 
-    void UpdateTexture(unsigned char* data, int width, int height);
+    // Persistently mapped pixel buffer the decoder can write frames into; nullptr without GL 4.4
+    uint8_t* CreateUploadBuffer(size_t frameSize, size_t slotCount);
+
+    // Number of uploads whose source frame can be reused since the last call
+    size_t RetireUploads(bool wait = false);
+
+    // Frames not from the decode queue (queued = false) are not counted by RetireUploads
+    void UpdateTexture(const VideoFrame& frame, bool queued = true);
     void Render(int windowWidth, int windowHeight, int videoWidth, int videoHeight);
+
+    // GPU time of the commands between the two calls, from a frame or two back
+    void BeginGpuTimer();
+    void EndGpuTimer();
+    double GetGpuMilliseconds() const { return gpuMilliseconds; }
+
+    // CPU time of UpdateTexture, smoothed over recent frames
+    double GetUploadMilliseconds() const { return uploadMilliseconds; }
 };
@@ -0,0 +1,125 @@
+#include "AudioOutput.h"
+#include "AudioReader.h"
+#include "Telemetry.h"
+
+#include <cstring>
+
+AudioOutput::AudioOutput() {}
+
+AudioOutput::~AudioOutput()
+{
+	Close();
+}
+
+bool AudioOutput::Open(int rate, int channelCount)
+{
+	Close();
+
+	sampleRate = rate;
+	channels = channelCount;
+
+	ma_device_config deviceConfig = ma_device_config_init(ma_device_type_playback);
+	deviceConfig.playback.format = ma_format_f32;
+	deviceConfig.playback.channels = channels;
+	deviceConfig.sampleRate = sampleRate;
+	deviceConfig.dataCallback = Callback;
+	deviceConfig.pUserData = this;
+
+	if (ma_device_init(NULL, &deviceConfig, &device) != MA_SUCCESS)
+		return false;
+
+	deviceInitialized = true;
+	return true;
+}
+
+bool AudioOutput::OpenHeadless(int rate, int channelCount)
+{
+	Close();
+
+	sampleRate = rate;
+	channels = channelCount;
+	headless = true;
+	return true;
+}
+
+void AudioOutput::Callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount)
+{
+	Telemetry::SetThreadName("audio device");
+	((AudioOutput*)pDevice->pUserData)->Render((float*)pOutput, frameCount);
+}
+
+uint32_t AudioOutput::Render(float* samples, uint32_t frameCount)
+{
+	TelemetryScope scope("audio callback");
+
+	AudioReader* reader = current.load(std::memory_order_acquire);
+	size_t done = reader ? reader->Render(samples, frameCount) : 0;
+
+	// Gapless handover: the rest of this period comes from the next item
+	while (done < frameCount && reader && reader->IsFinished())
+	{
+		AudioReader* upcoming = next.exchange(nullptr);
+		if (!upcoming)
+			break;
+
+		reader->Deactivate();
+		upcoming->Activate();
+		current.store(upcoming, std::memory_order_release);
+
+		reader = upcoming;
+		done += reader->Render(samples + done * channels, frameCount - done);
+	}
+
+	if (done < frameCount)
+		memset(samples + done * channels, 0, (frameCount - done) * channels * sizeof(float));
+
+	return (uint32_t)done;
+}
+
+bool AudioOutput::Start()
+{
+	if (!deviceInitialized)
+		return headless;
+
+	return ma_device_start(&device) == MA_SUCCESS;
+}
+
+void AudioOutput::Stop()
+{
+	if (deviceInitialized)
+		ma_device_stop(&device);
+}
+
+void AudioOutput::SetSource(AudioReader* reader)
+{
+	// Only switched with the device stopped or by the callback itself
+	current.store(reader);
+}
+
+void AudioOutput::SetVolume(float volume)
+{
+	if (deviceInitialized)
+		ma_device_set_master_volume(&device, volume);
+}
+
+double AudioOutput::GetLatency() const
+{
+	if (!deviceInitialized || device.playback.internalSampleRate == 0)
+		return 0.0;
+
+	return (double)device.playback.internalPeriodSizeInFrames * device.playback.internalPeriods /
+		   device.playback.internalSampleRate;
+}
+
+void AudioOutput::Close()
+{
+	if (deviceInitialized)
+	{
+		ma_device_uninit(&device);
+		deviceInitialized = false;
+	}
+	headless = false;
+
+	current = nullptr;
+	next = nullptr;
+}
@@ -1,8 +1,23 @@
 #include "AudioReader.h"
+#include "Telemetry.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Share of the gap to each new raw reading the clock corrects per query, and the gap that snaps it
+static const double ClockSlew = 0.05;
+static const double ClockSnapThreshold = 0.1;
+
+static int64_t MonotonicNanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 AudioReader::AudioReader()
 {
-	audioBuffer.resize(1024 * 1024 * 4);
+	audioBuffer.Init(1024 * 1024 * 4);
+	lowWatermark = audioBuffer.Capacity() / 4;
 }
 
 AudioReader::~AudioReader()
@@ -10,77 +25,96 @@ AudioReader::~AudioReader()
 	Close();
 }
 
-bool AudioReader::Open(const char* filename)
+bool AudioReader::Open(MediaSource* source, AudioOutput* audioOutput)
 {
-	av_log_set_level(AV_LOG_ERROR);
-	
-	avFormatCTX = avformat_alloc_context();
-	if (!avFormatCTX)
-		return false;
+	if (OpenStream(source, audioOutput))
+		return true;
 
-	if (avformat_open_input(&avFormatCTX, filename, nullptr, nullptr) != 0)
+	source->DisableAudio();
+	packetQueue = nullptr;
+	audioStreamIndex = -1;
+	return false;
+}
+
+bool AudioReader::OpenStream(MediaSource* source, AudioOutput* audioOutput)
+{
+	StopDecoding();
+	Detach();
+
+	mediaSource = source;
+	output = audioOutput;
+	audioStreamIndex = source->GetAudioStreamIndex();
+	packetQueue = source->GetAudioQueue();
+
+	if (audioStreamIndex == -1 || !packetQueue || !output)
 		return false;
 
-	if (avformat_find_stream_info(avFormatCTX, nullptr) < 0)
+	AVFormatContext* avFormatCTX = source->GetFormatContext();
+	AVStream* avStream = avFormatCTX->streams[audioStreamIndex];
+	AVCodecParameters* avCodecParams = avStream->codecpar;
+	const AVCodec* avCodec = avcodec_find_decoder(avCodecParams->codec_id);
+
+	if (!avCodec)
 		return false;
 
-	audioStreamIndex = -1;
-	AVCodecParameters* avCodecParams = nullptr;
-	const AVCodec* avCodec = nullptr;
+	timeBase = avStream->time_base;
+	duration = 0.0;
 
-	for (int i = 0; i < avFormatCTX->nb_streams; i++)
+	if (avStream->duration != AV_NOPTS_VALUE)
 	{
-		avCodecParams = avFormatCTX->streams[i]->codecpar;
-		avCodec = avcodec_find_decoder(avCodecParams->codec_id);
-
-		if (!avCodec)
-			continue;
+		duration = avStream->duration * av_q2d(avStream->time_base);
+	}
+	else if (avFormatCTX->duration != AV_NOPTS_VALUE)
+	{
+		duration = avFormatCTX->duration / (double)AV_TIME_BASE;
+	}
 
-		if (avCodecParams->codec_type == AVMEDIA_TYPE_AUDIO)
-		{
-			audioStreamIndex = i;
-			timeBase = avFormatCTX->streams[i]->time_base;
-			
-			AVStream* avStream = avFormatCTX->streams[audioStreamIndex];
-			if (avStream->duration != AV_NOPTS_VALUE)
-			{
-				duration = avStream->duration * av_q2d(avStream->time_base);
-			}
-			else if (avFormatCTX->duration != AV_NOPTS_VALUE)
-			{
-				duration = avFormatCTX->duration / (double)AV_TIME_BASE;
-			}
-			
-			sampleRate = avCodecParams->sample_rate;
-			channels = avCodecParams->ch_layout.nb_channels;
-			
-			break;
-		}
+	// Consecutive items usually share a format, so the open decoder is flushed and kept
+	if (avCodecCTX && openedParams && MediaSource::SameCodecParameters(openedParams, avCodecParams))
+	{
+		avcodec_flush_buffers(avCodecCTX);
+		avCodecCTX->pkt_timebase = avStream->time_base;
 	}
+	else
+	{
+		avcodec_free_context(&avCodecCTX);
 
-	if (audioStreamIndex == -1)
-		return false;
+		avCodecCTX = avcodec_alloc_context3(avCodec);
+		if (!avCodecCTX)
+			return false;
 
-	avCodecCTX = avcodec_alloc_context3(avCodec);
-	if (!avCodecCTX)
-		return false;
+		if (avcodec_parameters_to_context(avCodecCTX, avCodecParams) < 0)
+			return false;
 
-	if (avcodec_parameters_to_context(avCodecCTX, avCodecParams) < 0)
-		return false;
+		avCodecCTX->pkt_timebase = avStream->time_base;
 
-	if (avcodec_open2(avCodecCTX, avCodec, nullptr) < 0)
-		return false;
+		if (avcodec_open2(avCodecCTX, avCodec, nullptr) < 0)
+			return false;
+
+		if (!openedParams)
+			openedParams = avcodec_parameters_alloc();
+		if (!openedParams || avcodec_parameters_copy(openedParams, avCodecParams) < 0)
+			return false;
+	}
 
-	avFrame = av_frame_alloc();
-	avPacket = av_packet_alloc();
+	if (!avFrame)
+		avFrame = av_frame_alloc();
+	if (!avPacket)
+		avPacket = av_packet_alloc();
 
 	if (!avFrame || !avPacket)
 		return false;
 
-	AVChannelLayout out_ch_layout = AV_CHANNEL_LAYOUT_STEREO;
-	if (channels == 1)
-		out_ch_layout = AV_CHANNEL_LAYOUT_MONO;
+	if (!output->IsOpen() && !output->Open(avCodecParams->sample_rate, avCodecParams->ch_layout.nb_channels > 1 ? 2 : 1))
+		return false;
+
+	sampleRate = output->GetSampleRate();
+	channels = output->GetChannels();
+
+	AVChannelLayout out_ch_layout;
+	av_channel_layout_default(&out_ch_layout, channels);
 	
+	swr_free(&swrContext);
 	swr_alloc_set_opts2(&swrContext,
 						&out_ch_layout,
 						AV_SAMPLE_FMT_FLT,
@@ -94,74 +128,92 @@ bool AudioReader::Open(const char* filename)
 	if (!swrContext || swr_init(swrContext) < 0)
 		return false;
 
-	deviceConfig = ma_device_config_init(ma_device_type_playback);
-	deviceConfig.playback.format = ma_format_f32;
-	deviceConfig.playback.channels = channels;
-	deviceConfig.sampleRate = sampleRate;
-	deviceConfig.dataCallback = AudioCallback;
-	deviceConfig.pUserData = this;
+	stretcher.Init(sampleRate, channels);
+	stretcher.SetRate(playbackRate);
 
-	if (ma_device_init(NULL, &deviceConfig, &device) != MA_SUCCESS)
-		return false;
+	audioBuffer.Reset();
+	pendingAudio.clear();
+	pendingOffset = 0;
+	endOfStream = false;
+	currentPts = 0.0;
+	skipUntil = -1.0;
+
+	framesConsumed = 0;
+	callbackTime = 0;
+	clockBaseSet = false;
+	clockValid = false;
 
-	deviceInitialized = true;
 	return true;
 }
 
-void AudioReader::AudioCallback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount)
+size_t AudioReader::Render(float* samples, size_t frameCount)
 {
-	AudioReader* reader = (AudioReader*)pDevice->pUserData;
-	float* output = (float*)pOutput;
+	size_t frameBytes = channels * sizeof(float);
+	size_t framesRead = audioBuffer.Read((uint8_t*)samples, frameCount * frameBytes) / frameBytes;
+
+	if (framesRead < frameCount && isPlaying && !endOfStream)
+		Telemetry::Mark("audio underrun");
+
+	// Only real samples advance the clock; silence played during an underrun does not
+	uint32_t sequence = clockSequence.load(std::memory_order_relaxed);
+	clockSequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	framesConsumed.fetch_add(framesRead, std::memory_order_relaxed);
+	callbackTime.store(MonotonicNanoseconds(), std::memory_order_relaxed);
+	callbackFrames.store((uint32_t)frameCount, std::memory_order_relaxed);
+	clockSequence.store(sequence + 2, std::memory_order_release);
 	
-	std::lock_guard<std::mutex> lock(reader->bufferMutex);
-	
-	size_t bytesNeeded = frameCount * reader->channels * sizeof(float);
-	size_t bytesAvailable = reader->bufferWritePos - reader->bufferReadPos;
-	
-	if (bytesAvailable >= bytesNeeded)
-	{
-		memcpy(output, &reader->audioBuffer[reader->bufferReadPos], bytesNeeded);
-		reader->bufferReadPos += bytesNeeded;
-	}
-	else
+	// notify_one without the mutex keeps the real-time thread lock-free;
+	// the refill thread's timed wait covers a wakeup lost to that race
+	if (!endOfStream && audioBuffer.AvailableRead() < lowWatermark && !refillRequested.exchange(true))
 	{
-		if (bytesAvailable > 0)
-			memcpy(output, &reader->audioBuffer[reader->bufferReadPos], bytesAvailable);
-		memset((uint8_t*)output + bytesAvailable, 0, bytesNeeded - bytesAvailable);
-		reader->bufferReadPos += bytesAvailable;
-	}
-	
-	if (reader->bufferReadPos >= reader->audioBuffer.size() / 2)
-	{
-		size_t remaining = reader->bufferWritePos - reader->bufferReadPos;
-		if (remaining > 0)
-			memmove(&reader->audioBuffer[0], &reader->audioBuffer[reader->bufferReadPos], remaining);
-		reader->bufferWritePos = remaining;
-		reader->bufferReadPos = 0;
+		refillCond.notify_one();
 	}
+
+	return framesRead;
+}
+
+void AudioReader::Activate()
+{
+	isPlaying = true;
+	if (!refillRequested.exchange(true))
+		refillCond.notify_one();
+}
+
+bool AudioReader::FlushPendingAudio()
+{
+	if (pendingOffset < pendingAudio.size())
+		pendingOffset += audioBuffer.Write(&pendingAudio[pendingOffset], pendingAudio.size() - pendingOffset);
+
+	return pendingOffset == pendingAudio.size();
 }
 
 bool AudioReader::ReadAndDecodeAudioFrame()
 {
 	while (true)
 	{
-		int ret = av_read_frame(avFormatCTX, avPacket);
-		if (ret < 0)
-			return false;
-
-		if (avPacket->stream_index != audioStreamIndex)
+		if (!packetQueue->Pop(avPacket))
 		{
-			av_packet_unref(avPacket);
-			continue;
+			endOfStream = decoding.load();
+			return false;
 		}
 
+		int64_t decodeStart = MonotonicNanoseconds();
+		int64_t spanStart = Telemetry::Begin();
+
 		int response = avcodec_send_packet(avCodecCTX, avPacket);
 		av_packet_unref(avPacket);
 
 		if (response < 0)
+		{
+			Telemetry::End("audio decode", spanStart);
+			decodeNanoseconds += MonotonicNanoseconds() - decodeStart;
 			return false;
+		}
 
 		response = avcodec_receive_frame(avCodecCTX, avFrame);
+		Telemetry::End("audio decode", spanStart);
+		decodeNanoseconds += MonotonicNanoseconds() - decodeStart;
 
 		if (response == AVERROR(EAGAIN))
 			continue;
@@ -171,14 +223,38 @@ bool AudioReader::ReadAndDecodeAudioFrame()
 		break;
 	}
 
+	samplesDecoded += avFrame->nb_samples;
+
 	if (avFrame->pts != AV_NOPTS_VALUE)
 		currentPts = avFrame->pts * av_q2d(timeBase);
 
+	if (!clockBaseSet)
+	{
+		clockBase = currentPts;
+		clockBaseSet = true;
+	}
+
+	// The shared demuxer seeks to the video keyframe, so drop audio decoded before the target,
+	// trimming the frame that straddles it so the ring starts exactly at the clock base
+	int trimSamples = 0;
+	if (skipUntil >= 0.0)
+	{
+		double frameEnd = currentPts + (double)avFrame->nb_samples / avCodecCTX->sample_rate;
+		if (frameEnd < skipUntil)
+			return true;
+
+		trimSamples = std::max(0, (int)std::lround((skipUntil - currentPts) * sampleRate));
+		skipUntil = -1.0;
+	}
+
 	int maxOutSamples = av_rescale_rnd(avFrame->nb_samples, 
 										sampleRate, 
 										avCodecCTX->sample_rate, 
 										AV_ROUND_UP);
 	
+	int64_t resampleStart = MonotonicNanoseconds();
+	int64_t spanStart = Telemetry::Begin();
+
 	uint8_t** outBuffer = nullptr;
 	int outLinesize = 0;
 	
@@ -195,16 +271,29 @@ bool AudioReader::ReadAndDecodeAudioFrame()
 								  (const uint8_t**)avFrame->data,
 								  avFrame->nb_samples);
 
-	if (outSamples > 0)
+	if (outSamples > trimSamples)
 	{
-		size_t dataSize = outSamples * channels * sizeof(float);
-		
-		std::lock_guard<std::mutex> lock(bufferMutex);
+		const uint8_t* samples = outBuffer[0] + trimSamples * channels * sizeof(float);
+		size_t dataSize = (outSamples - trimSamples) * channels * sizeof(float);
+
+		if (playbackRate != 1.0)
+		{
+			stretched.clear();
+			stretcher.Process((const float*)samples, outSamples - trimSamples, stretched);
+			samples = (const uint8_t*)stretched.data();
+			dataSize = stretched.size() * sizeof(float);
+		}
+
+		Telemetry::End("swr_convert", spanStart);
+		resampleNanoseconds += MonotonicNanoseconds() - resampleStart;
+
+		size_t written = audioBuffer.Write(samples, dataSize);
 		
-		if (bufferWritePos + dataSize < audioBuffer.size())
+		// Keep what did not fit instead of dropping it; FillBuffer writes it before decoding more
+		if (written < dataSize)
 		{
-			memcpy(&audioBuffer[bufferWritePos], outBuffer[0], dataSize);
-			bufferWritePos += dataSize;
+			pendingAudio.assign(samples + written, samples + dataSize);
+			pendingOffset = 0;
 		}
 	}
 
@@ -217,35 +306,43 @@ bool AudioReader::ReadAndDecodeAudioFrame()
 	return true;
 }
 
+AudioDecodeStats AudioReader::GetDecodeStats() const
+{
+	AudioDecodeStats stats;
+	stats.samplesDecoded = samplesDecoded;
+	stats.decodeSeconds = decodeNanoseconds * 1e-9;
+	stats.resampleSeconds = resampleNanoseconds * 1e-9;
+	return stats;
+}
+
 void AudioReader::FillBuffer()
 {
 	if (!isPlaying && !isPrefilling)
 		return;
 	
-	size_t available;
-	{
-		std::lock_guard<std::mutex> lock(bufferMutex);
-		available = bufferWritePos - bufferReadPos;
-	}
-	
-	size_t targetSize = audioBuffer.size() / 2;
+	size_t targetSize = audioBuffer.Capacity() / 2;
 	
-	while (available < targetSize)
+	while (audioBuffer.AvailableRead() < targetSize && decoding)
 	{
+		if (!FlushPendingAudio())
+			break;
+		
 		if (!ReadAndDecodeAudioFrame())
 			break;
-			
-		std::lock_guard<std::mutex> lock(bufferMutex);
-		available = bufferWritePos - bufferReadPos;
 	}
 }
 
-bool AudioReader::PrefillBuffer()
+bool AudioReader::PrefillBuffer(double seconds)
 {
 	isPrefilling = true;
+
+	size_t targetBytes = (size_t)(seconds * sampleRate) * channels * sizeof(float);
 	
-	for (int i = 0; i < 20; i++)
+	for (int i = 0; seconds > 0.0 ? audioBuffer.AvailableRead() < targetBytes : i < 20; i++)
 	{
+		if (!FlushPendingAudio())
+			break;
+		
 		if (!ReadAndDecodeAudioFrame())
 		{
 			isPrefilling = false;
@@ -257,14 +354,74 @@ bool AudioReader::PrefillBuffer()
 	return true;
 }
 
+void AudioReader::StartDecoding()
+{
+	if (decoding || !avCodecCTX || !packetQueue)
+		return;
+	
+	decoding = true;
+	endOfStream = false;
+	refillRequested = true;
+	decodeThread = std::thread(&AudioReader::DecodeLoop, this);
+}
+
+void AudioReader::StopDecoding()
+{
+	if (!decodeThread.joinable())
+		return;
+	
+	{
+		std::lock_guard<std::mutex> lock(decodeMutex);
+		decoding = false;
+	}
+	refillCond.notify_one();
+	packetQueue->Abort(true);
+	
+	decodeThread.join();
+	
+	packetQueue->Abort(false);
+}
+
+void AudioReader::DecodeLoop()
+{
+	std::unique_lock<std::mutex> lock(decodeMutex);
+
+	Telemetry::SetThreadName("audio decoder");
+	
+	while (decoding)
+	{
+		refillCond.wait_for(lock, std::chrono::milliseconds(250), [this]() {
+			return !decoding || refillRequested;
+		});
+		
+		if (!decoding)
+			break;
+		
+		if (!refillRequested.exchange(false))
+			continue;
+		
+		lock.unlock();
+		FillBuffer();
+		lock.lock();
+	}
+}
+
 bool AudioReader::Play()
 {
-	if (!deviceInitialized)
+	if (!output || !output->IsOpen())
 		return false;
+
+	AudioReader* previous = output->GetSource();
+	if (previous != this)
+	{
+		output->SetSource(this);
+		if (previous)
+			previous->Deactivate();
+	}
 	
 	isPlaying = true;
 	
-	if (ma_device_start(&device) != MA_SUCCESS)
+	if (!output->Start())
 	{
 		isPlaying = false;
 		return false;
@@ -276,40 +433,43 @@ bool AudioReader::Play()
 void AudioReader::Pause()
 {
 	isPlaying = false;
-	if (deviceInitialized)
-		ma_device_stop(&device);
+	if (output && output->GetSource() == this)
+		output->Stop();
 }
 
 void AudioReader::Stop()
 {
-	isPlaying = false;
-	if (deviceInitialized)
-		ma_device_stop(&device);
+	Pause();
 	
-	std::lock_guard<std::mutex> lock(bufferMutex);
-	bufferReadPos = 0;
-	bufferWritePos = 0;
+	audioBuffer.Reset();
+	pendingAudio.clear();
+	pendingOffset = 0;
 }
 
 bool AudioReader::Seek(double targetTime)
 {
-	if (!avFormatCTX || audioStreamIndex < 0)
+	if (!avCodecCTX || audioStreamIndex < 0)
 		return false;
 
-	bool wasPlaying = isPlaying;
 	Pause();
 	
-	std::lock_guard<std::mutex> lock(bufferMutex);
-	bufferReadPos = 0;
-	bufferWritePos = 0;
-
-	int64_t timestamp = (int64_t)(targetTime / av_q2d(timeBase));
-
-	if (av_seek_frame(avFormatCTX, audioStreamIndex, timestamp, AVSEEK_FLAG_BACKWARD) < 0)
-		return false;
+	// The device is stopped, so the callback cannot be reading while we reset
+	audioBuffer.Reset();
+	pendingAudio.clear();
+	pendingOffset = 0;
+	endOfStream = false;
 
 	avcodec_flush_buffers(avCodecCTX);
+	stretcher.Reset();
 	currentPts = targetTime;
+	skipUntil = targetTime;
+
+	// The callback is stopped, so the clock can restart from the target
+	framesConsumed = 0;
+	callbackTime = 0;
+	clockBase = targetTime;
+	clockBaseSet = true;
+	clockValid = false;
 
 	return true;
 }
@@ -319,6 +479,72 @@ double AudioReader::GetCurrentTime() const
 	return currentPts;
 }
 
+double AudioReader::GetClock()
+{
+	auto now = std::chrono::steady_clock::now();
+
+	if (!clockBaseSet)
+		return currentPts;
+
+	uint32_t sequence;
+	uint64_t frames;
+	int64_t stamp;
+	uint32_t period;
+	do
+	{
+		sequence = clockSequence.load(std::memory_order_acquire);
+		frames = framesConsumed.load(std::memory_order_relaxed);
+		stamp = callbackTime.load(std::memory_order_relaxed);
+		period = callbackFrames.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((sequence & 1) || clockSequence.load(std::memory_order_relaxed) != sequence);
+
+	// The device keeps playing between callbacks, but never past what it was given
+	double elapsed = 0.0;
+	if (isPlaying && stamp != 0)
+	{
+		elapsed = (MonotonicNanoseconds() - stamp) * 1e-9;
+		elapsed = std::clamp(elapsed, 0.0, (double)period / sampleRate);
+	}
+
+	// Paused: hold the last reading rather than jump back by the discarded device buffer
+	if (!isPlaying && clockValid)
+		return smoothedClock;
+
+	// Each second of output carries playbackRate seconds of media
+	double raw = clockBase + ((double)frames / sampleRate - GetDeviceLatency() + elapsed) * playbackRate;
+	raw = std::max(raw, clockBase.load());
+
+	if (!clockValid || std::abs(raw - smoothedClock) > ClockSnapThreshold)
+	{
+		smoothedClock = raw;
+		clockValid = true;
+	}
+	else
+	{
+		double predicted = smoothedClock + std::chrono::duration<double>(now - lastClockQuery).count() * playbackRate;
+		smoothedClock = std::max(smoothedClock, predicted + (raw - predicted) * ClockSlew);
+	}
+
+	lastClockQuery = now;
+	return smoothedClock;
+}
+
+void AudioReader::SetPlaybackRate(double rate)
+{
+	if (decoding || rate <= 0.0)
+		return;
+
+	playbackRate = rate;
+	stretcher.SetRate(rate);
+	stretcher.Reset();
+}
+
+double AudioReader::GetDeviceLatency() const
+{
+	return output ? output->GetLatency() : 0.0;
+}
+
 void AudioReader::SetMasterTime(double time)
 {
 	masterTime = time;
@@ -326,23 +552,40 @@ void AudioReader::SetMasterTime(double time)
 
 double AudioReader::GetAudioLatency() const
 {
-	if (!deviceInitialized)
+	if (!output)
 		return 0.0;
 	
-	size_t bytesInBuffer = bufferWritePos - bufferReadPos;
+	size_t bytesInBuffer = audioBuffer.AvailableRead();
 	size_t samplesInBuffer = bytesInBuffer / (channels * sizeof(float));
 	return (double)samplesInBuffer / (double)sampleRate;
 }
 
+void AudioReader::Detach()
+{
+	// Nothing may be left pointing at this reader once it is reset
+	if (!output)
+		return;
+
+	if (output->GetQueued() == this)
+		output->QueueNext(nullptr);
+
+	if (output->GetSource() == this)
+	{
+		output->Stop();
+		output->SetSource(nullptr);
+	}
+
+	isPlaying = false;
+}
+
 void AudioReader::Close()
 {
+	StopDecoding();
+	Detach();
 	Stop();
 	
-	if (deviceInitialized)
-	{
-		ma_device_uninit(&device);
-		deviceInitialized = false;
-	}
+	if (openedParams)
+		avcodec_parameters_free(&openedParams);
 
 	if (swrContext)
 	{
@@ -368,9 +611,7 @@ void AudioReader::Close()
 		avCodecCTX = nullptr;
 	}
 
-	if (avFormatCTX)
-	{
-		avformat_close_input(&avFormatCTX);
-		avFormatCTX = nullptr;
-	}
+	mediaSource = nullptr;
+	packetQueue = nullptr;
+	output = nullptr;
 }
@@ -0,0 +1,48 @@
+#include "CacheFile.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <sys/stat.h>
+
+std::string CacheFile::PathFor(const char* mediaPath, const char* extension)
+{
+	std::string directory;
+
+	if (const char* xdgCache = getenv("XDG_CACHE_HOME"))
+		directory = xdgCache;
+	else if (const char* home = getenv("HOME"))
+		directory = std::string(home) + "/.cache";
+	else
+		return std::string();
+
+	mkdir(directory.c_str(), 0755);
+	directory += "/video-app";
+	mkdir(directory.c_str(), 0755);
+
+	char absolute[PATH_MAX];
+	const char* key = realpath(mediaPath, absolute) ? absolute : mediaPath;
+
+	// FNV-1a keeps names short and stable across runs
+	uint64_t hash = 1469598103934665603ULL;
+	for (const char* c = key; *c; c++)
+	{
+		hash ^= (uint8_t)*c;
+		hash *= 1099511628211ULL;
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "/%016llx.%s", (unsigned long long)hash, extension);
+	return directory + name;
+}
+
+bool CacheFile::GetFileStamp(const char* path, int64_t* size, int64_t* mtime)
+{
+	struct stat info;
+	if (stat(path, &info) != 0)
+		return false;
+
+	*size = (int64_t)info.st_size;
+	*mtime = (int64_t)info.st_mtime;
+	return true;
+}
@@ -0,0 +1,108 @@
+#include "FrameCache.h"
+
+#include <cmath>
+
+FrameCache::FrameCache() {}
+
+void FrameCache::Init(size_t budgetBytes)
+{
+	Clear();
+	budget = budgetBytes;
+}
+
+void FrameCache::Clear()
+{
+	entries.clear();
+	spare.clear();
+	usedBytes = 0;
+}
+
+void FrameCache::Store(const VideoFrame& frame)
+{
+	if (entries.count(frame.pts))
+		return;
+
+	int size = av_image_get_buffer_size(frame.format, frame.width, frame.height, 1);
+	if (size <= 0 || (size_t)size > budget)
+		return;
+
+	// Buffers of evicted frames are reused; frame sizes only change with the stream
+	Entry entry;
+	if (!spare.empty())
+	{
+		entry.data.swap(spare.back());
+		spare.pop_back();
+	}
+	entry.data.resize(size);
+
+	uint8_t* planes[4];
+	int linesizes[4];
+	av_image_fill_arrays(planes, linesizes, entry.data.data(), frame.format, frame.width, frame.height, 1);
+	av_image_copy(planes, linesizes, (const uint8_t* const*)frame.planes, frame.linesizes, frame.format, frame.width, frame.height);
+
+	entry.format = frame.format;
+	entry.colorspace = frame.colorspace;
+	entry.colorRange = frame.colorRange;
+	entry.width = frame.width;
+	entry.height = frame.height;
+	entry.time = frame.time;
+
+	usedBytes += size;
+	entries.emplace(frame.pts, std::move(entry));
+
+	Evict(frame.pts);
+}
+
+void FrameCache::Evict(int64_t keep)
+{
+	const Entry& kept = entries.at(keep);
+
+	// Entries are ordered by pts, so the farthest frame is always at one end
+	while (usedBytes > budget && entries.size() > 1)
+	{
+		auto first = entries.begin();
+		auto last = std::prev(entries.end());
+		auto victim = (kept.time - first->second.time) > (last->second.time - kept.time) ? first : last;
+		if (victim->first == keep)
+			victim = victim == first ? last : first;
+
+		usedBytes -= victim->second.data.size();
+		spare.push_back(std::move(victim->second.data));
+		entries.erase(victim);
+	}
+}
+
+bool FrameCache::FindAdjacent(double time, int direction, double maxGap, VideoFrame* frame) const
+{
+	const std::pair<const int64_t, Entry>* found = nullptr;
+
+	// Few enough entries that a scan by time is cheaper than a second index
+	for (const auto& item : entries)
+	{
+		double gap = (item.second.time - time) * direction;
+		if (gap <= 1e-6 || gap > maxGap)
+			continue;
+
+		if (!found || std::abs(item.second.time - time) < std::abs(found->second.time - time))
+			found = &item;
+	}
+
+	if (!found)
+		return false;
+
+	Describe(found->second, found->first, frame);
+	return true;
+}
+
+void FrameCache::Describe(const Entry& entry, int64_t pts, VideoFrame* frame)
+{
+	*frame = VideoFrame();
+	av_image_fill_arrays(frame->planes, frame->linesizes, (uint8_t*)entry.data.data(), entry.format, entry.width, entry.height, 1);
+	frame->format = entry.format;
+	frame->colorspace = entry.colorspace;
+	frame->colorRange = entry.colorRange;
+	frame->width = entry.width;
+	frame->height = entry.height;
+	frame->pts = pts;
+	frame->time = entry.time;
+}
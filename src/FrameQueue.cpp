@@ -0,0 +1,166 @@
+#include "FrameQueue.h"
+
+FrameQueue::FrameQueue() {}
+
+FrameQueue::~FrameQueue()
+{
+	FreeFrames();
+}
+
+void FrameQueue::FreeFrames()
+{
+	for (VideoFrame& frame : frames)
+	{
+		av_frame_free(&frame.frame);
+		av_buffer_unref(&frame.converted);
+	}
+}
+
+void FrameQueue::Init(size_t depth, size_t frameSize, uint8_t* storage)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	FreeFrames();
+	frames.assign(depth < 1 ? 1 : depth, VideoFrame());
+	discarded.assign(frames.size(), false);
+
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		VideoFrame& frame = frames[i];
+		frame.frame = av_frame_alloc();
+
+		if (storage)
+		{
+			frame.data = storage + i * frameSize;
+			frame.bufferOffset = i * frameSize;
+		}
+	}
+
+	readIndex = 0;
+	writeIndex = 0;
+	count = 0;
+	inFlight = 0;
+}
+
+VideoFrame* FrameQueue::PeekWritable()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	cond.wait(lock, [this]() { return aborted || count + inFlight < frames.size(); });
+
+	if (aborted)
+		return nullptr;
+
+	return &frames[writeIndex];
+}
+
+void FrameQueue::Push()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		writeIndex = (writeIndex + 1) % frames.size();
+		count++;
+	}
+	cond.notify_all();
+}
+
+VideoFrame* FrameQueue::PeekReadable(size_t offset)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (offset >= count)
+		return nullptr;
+
+	return &frames[(readIndex + offset) % frames.size()];
+}
+
+void FrameQueue::Pop()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (count == 0)
+		return;
+
+	readIndex = (readIndex + 1) % frames.size();
+	count--;
+	inFlight++;
+}
+
+void FrameQueue::Discard()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (count == 0)
+			return;
+
+		av_frame_unref(frames[readIndex].frame);
+		av_buffer_unref(&frames[readIndex].converted);
+		discarded[readIndex] = true;
+		readIndex = (readIndex + 1) % frames.size();
+		count--;
+		inFlight++;
+
+		ReleaseDiscarded();
+	}
+	cond.notify_all();
+}
+
+void FrameQueue::Release()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (inFlight == 0)
+			return;
+
+		inFlight--;
+		ReleaseDiscarded();
+	}
+	cond.notify_all();
+}
+
+void FrameQueue::ReleaseDiscarded()
+{
+	// In-flight slots are freed oldest first; discarded ones go as soon as they are the oldest
+	while (inFlight > 0)
+	{
+		size_t oldest = (readIndex + frames.size() - inFlight) % frames.size();
+		if (!discarded[oldest])
+			break;
+
+		discarded[oldest] = false;
+		inFlight--;
+	}
+}
+
+void FrameQueue::Flush()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		readIndex = 0;
+		writeIndex = 0;
+		count = 0;
+		inFlight = 0;
+		discarded.assign(frames.size(), false);
+
+		// Hand decoder buffers back to their pools instead of pinning them until reuse
+		for (VideoFrame& frame : frames)
+		{
+			av_frame_unref(frame.frame);
+			av_buffer_unref(&frame.converted);
+		}
+	}
+	cond.notify_all();
+}
+
+void FrameQueue::Abort(bool abort)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		aborted = abort;
+	}
+	cond.notify_all();
+}
+
+size_t FrameQueue::Size() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return count;
+}
@@ -0,0 +1,214 @@
+#include "KeyframeIndex.h"
+#include "CacheFile.h"
+#include "MappedInput.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static const char KeyframeIndexMagic[4] = { 'K', 'F', 'I', 'X' };
+static const uint32_t KeyframeIndexVersion = 1;
+
+KeyframeIndex::KeyframeIndex() {}
+
+KeyframeIndex::~KeyframeIndex()
+{
+	Close();
+}
+
+void KeyframeIndex::Open(const char* filename, int videoStreamIndex)
+{
+	Close();
+
+	mediaPath = filename;
+	streamIndex = videoStreamIndex;
+
+	// Only local files have a stamp to validate a cache against
+	if (streamIndex < 0 || !CacheFile::GetFileStamp(filename, &fileSize, &modifiedTime))
+		return;
+
+	cachePath = CacheFile::PathFor(filename, "kfidx");
+
+	if (Load())
+		return;
+
+	building = true;
+	buildThread = std::thread(&KeyframeIndex::Build, this);
+}
+
+bool KeyframeIndex::Load()
+{
+	if (cachePath.empty())
+		return false;
+
+	int fd = open(cachePath.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	off_t size = lseek(fd, 0, SEEK_END);
+	void* data = size >= (off_t)sizeof(Header) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return false;
+
+	const Header* header = (const Header*)data;
+	bool valid = memcmp(header->magic, KeyframeIndexMagic, 4) == 0 &&
+				 header->version == KeyframeIndexVersion &&
+				 header->fileSize == fileSize &&
+				 header->modifiedTime == modifiedTime &&
+				 header->streamIndex == streamIndex &&
+				 header->entryCount >= 0 &&
+				 (size_t)size == sizeof(Header) + header->entryCount * sizeof(Entry);
+
+	if (!valid)
+	{
+		munmap(data, size);
+		return false;
+	}
+
+	mapping = data;
+	mappingSize = size;
+	entries = (const Entry*)((const uint8_t*)data + sizeof(Header));
+	entryCount = header->entryCount;
+	frameCount = header->frameCount;
+	ready = true;
+	return true;
+}
+
+void KeyframeIndex::Build()
+{
+	AVFormatContext* formatCTX = avformat_alloc_context();
+	AVPacket* packet = av_packet_alloc();
+	MappedInput input;
+	std::vector<Entry> found;
+	int64_t frames = 0;
+	bool complete = false;
+
+	// Shares the playback demuxer's mapping, so the pages read here are the ones it will want
+	if (formatCTX)
+		input.Attach(formatCTX, mediaPath.c_str());
+
+	if (packet && formatCTX && avformat_open_input(&formatCTX, mediaPath.c_str(), nullptr, nullptr) == 0 &&
+		avformat_find_stream_info(formatCTX, nullptr) >= 0 &&
+		streamIndex < (int)formatCTX->nb_streams)
+	{
+		for (unsigned int i = 0; i < formatCTX->nb_streams; i++)
+		{
+			if ((int)i != streamIndex)
+				formatCTX->streams[i]->discard = AVDISCARD_ALL;
+		}
+
+		while (building)
+		{
+			int ret = av_read_frame(formatCTX, packet);
+			if (ret < 0)
+			{
+				complete = ret == AVERROR_EOF;
+				break;
+			}
+
+			if (packet->stream_index == streamIndex)
+			{
+				int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+
+				if ((packet->flags & AV_PKT_FLAG_KEY) && pts != AV_NOPTS_VALUE)
+					found.push_back({ pts, packet->pos, frames });
+
+				frames++;
+			}
+
+			av_packet_unref(packet);
+		}
+	}
+
+	av_packet_free(&packet);
+	if (formatCTX)
+		avformat_close_input(&formatCTX);
+	input.Close();
+
+	if (!complete)
+		return;
+
+	// Open GOPs can store keyframes slightly out of presentation order
+	std::sort(found.begin(), found.end(), [](const Entry& a, const Entry& b) { return a.pts < b.pts; });
+
+	builtEntries = std::move(found);
+	entries = builtEntries.data();
+	entryCount = builtEntries.size();
+	frameCount = frames;
+
+	Save();
+	ready = true;
+}
+
+void KeyframeIndex::Save()
+{
+	if (cachePath.empty())
+		return;
+
+	std::string temporaryPath = cachePath + ".tmp";
+	FILE* file = fopen(temporaryPath.c_str(), "wb");
+	if (!file)
+		return;
+
+	Header header = {};
+	memcpy(header.magic, KeyframeIndexMagic, 4);
+	header.version = KeyframeIndexVersion;
+	header.fileSize = fileSize;
+	header.modifiedTime = modifiedTime;
+	header.streamIndex = streamIndex;
+	header.frameCount = frameCount;
+	header.entryCount = (int64_t)entryCount;
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+				   fwrite(entries, sizeof(Entry), entryCount, file) == entryCount;
+
+	if (fclose(file) != 0 || !written)
+	{
+		remove(temporaryPath.c_str());
+		return;
+	}
+
+	rename(temporaryPath.c_str(), cachePath.c_str());
+}
+
+const KeyframeIndex::Entry* KeyframeIndex::Find(int64_t pts) const
+{
+	if (!ready || entryCount == 0)
+		return nullptr;
+
+	const Entry* end = entries + entryCount;
+	const Entry* after = std::upper_bound(entries, end, pts, [](int64_t value, const Entry& entry) {
+		return value < entry.pts;
+	});
+
+	if (after == entries)
+		return nullptr;
+
+	return after - 1;
+}
+
+void KeyframeIndex::Close()
+{
+	building = false;
+	if (buildThread.joinable())
+		buildThread.join();
+
+	ready = false;
+
+	if (mapping)
+	{
+		munmap(mapping, mappingSize);
+		mapping = nullptr;
+		mappingSize = 0;
+	}
+
+	builtEntries.clear();
+	entries = nullptr;
+	entryCount = 0;
+	frameCount = 0;
+}
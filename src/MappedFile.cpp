@@ -0,0 +1,167 @@
+#include "MappedFile.h"
+
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <climits>
+#include <cstdlib>
+#include <cerrno>
+#include <ctime>
+#include <cstring>
+#include <csetjmp>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Live mappings by absolute path; entries expire with their last user
+static std::mutex registryMutex;
+static std::map<std::string, std::weak_ptr<MappedFile>> registry;
+
+// SIGBUS during Copy jumps back into it; any other SIGBUS goes to whoever handled it before
+static struct sigaction previousBusAction;
+static std::once_flag busHandlerInstalled;
+static thread_local sigjmp_buf copyJump;
+static thread_local volatile sig_atomic_t copying = 0;
+
+static void BusHandler(int signal, siginfo_t* info, void* context)
+{
+	if (copying)
+	{
+		copying = 0;
+		siglongjmp(copyJump, 1);
+	}
+
+	// Returning re-runs the faulting access under the previous disposition
+	sigaction(SIGBUS, &previousBusAction, nullptr);
+}
+
+static void InstallBusHandler()
+{
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = BusHandler;
+	// NODEFER keeps SIGBUS unblocked after the jump, so the jump can skip the signal mask syscall
+	action.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGBUS, &action, &previousBusAction);
+}
+
+static int64_t ModifiedNanoseconds(const struct stat& info)
+{
+	return (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+MappedFile::~MappedFile()
+{
+	if (data)
+		munmap((void*)data, size);
+	if (fd >= 0)
+		close(fd);
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	auto found = registry.find(key);
+	if (found != registry.end() && found->second.expired())
+		registry.erase(found);
+}
+
+std::shared_ptr<MappedFile> MappedFile::Open(const char* path)
+{
+	char absolute[PATH_MAX];
+	if (!realpath(path, absolute))
+		return nullptr;
+
+	int fd = open(absolute, O_RDONLY);
+	if (fd < 0)
+		return nullptr;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0 ||
+		time(nullptr) - info.st_mtime < RecentWriteSeconds)
+	{
+		close(fd);
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+
+	auto found = registry.find(absolute);
+	if (found != registry.end())
+	{
+		std::shared_ptr<MappedFile> shared = found->second.lock();
+		if (shared && shared->size == (int64_t)info.st_size && shared->modifiedTime == ModifiedNanoseconds(info))
+		{
+			close(fd);
+			return shared;
+		}
+	}
+
+	void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED)
+	{
+		close(fd);
+		return nullptr;
+	}
+
+	std::call_once(busHandlerInstalled, InstallBusHandler);
+
+	// Playback reads front to back; seeks prefetch their target explicitly
+	madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+
+	std::shared_ptr<MappedFile> file(new MappedFile());
+	file->key = absolute;
+	file->fd = fd;
+	file->data = (const uint8_t*)mapping;
+	file->size = (int64_t)info.st_size;
+	file->modifiedTime = ModifiedNanoseconds(info);
+
+	registry[file->key] = file;
+	return file;
+}
+
+void MappedFile::Prefetch(int64_t offset, int64_t length) const
+{
+	if (offset < 0 || offset >= size || length <= 0)
+		return;
+
+	// madvise wants a page-aligned start
+	static const int64_t pageSize = sysconf(_SC_PAGESIZE);
+	int64_t start = offset - offset % pageSize;
+	int64_t end = std::min(offset + length, size);
+
+	madvise((void*)(data + start), end - start, MADV_WILLNEED);
+}
+
+bool MappedFile::Copy(uint8_t* buffer, int64_t offset, int size) const
+{
+	if (sigsetjmp(copyJump, 0))
+		return false;
+
+	copying = 1;
+	memcpy(buffer, data + offset, size);
+	copying = 0;
+	return true;
+}
+
+bool MappedFile::IsUnchanged() const
+{
+	struct stat info;
+	return fstat(fd, &info) == 0 && (int64_t)info.st_size == size && ModifiedNanoseconds(info) == modifiedTime;
+}
+
+int MappedFile::ReadAt(uint8_t* buffer, int64_t offset, int size) const
+{
+	ssize_t count;
+	do
+		count = pread(fd, buffer, size, offset);
+	while (count < 0 && errno == EINTR);
+
+	return count < 0 ? -errno : (int)count;
+}
+
+int64_t MappedFile::GetCurrentSize() const
+{
+	struct stat info;
+	return fstat(fd, &info) == 0 ? (int64_t)info.st_size : size;
+}
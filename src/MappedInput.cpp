@@ -0,0 +1,148 @@
+#include "MappedInput.h"
+
+#include <cstring>
+#include <algorithm>
+
+extern "C"
+{
+#include <libavutil/mem.h>
+}
+
+// Bytes handed to the demuxer per read callback
+static const int IOBufferSize = 64 * 1024;
+
+MappedInput::MappedInput() {}
+
+MappedInput::~MappedInput()
+{
+	Close();
+}
+
+bool MappedInput::Attach(AVFormatContext* formatCTX, const char* filename)
+{
+	Close();
+
+	file = MappedFile::Open(filename);
+	if (!file)
+		return false;
+
+	uint8_t* buffer = (uint8_t*)av_malloc(IOBufferSize);
+	if (buffer)
+		ioCTX = avio_alloc_context(buffer, IOBufferSize, 0, this, &MappedInput::Read, nullptr, &MappedInput::Seek);
+
+	if (!ioCTX)
+	{
+		av_free(buffer);
+		file.reset();
+		return false;
+	}
+
+	position = 0;
+	prefetchedUntil = 0;
+	fileChanged = false;
+
+	formatCTX->pb = ioCTX;
+	formatCTX->flags |= AVFMT_FLAG_CUSTOM_IO;
+	return true;
+}
+
+void MappedInput::Close()
+{
+	if (ioCTX)
+	{
+		av_freep(&ioCTX->buffer);
+		avio_context_free(&ioCTX);
+	}
+
+	file.reset();
+}
+
+void MappedInput::Prefetch(int64_t offset)
+{
+	if (file)
+		file->Prefetch(offset, ReadAheadBytes);
+}
+
+int64_t MappedInput::CurrentSize()
+{
+	if (!fileChanged && !file->IsUnchanged())
+		fileChanged = true;
+
+	return fileChanged ? file->GetCurrentSize() : file->GetSize();
+}
+
+int MappedInput::Read(void* opaque, uint8_t* buffer, int size)
+{
+	MappedInput* input = (MappedInput*)opaque;
+
+	if (!input->fileChanged)
+	{
+		int64_t remaining = input->file->GetSize() - input->position;
+
+		// The end of the mapping is only the end of the file if the file has not grown since
+		if (remaining <= 0 && input->file->IsUnchanged())
+			return AVERROR_EOF;
+
+		if (remaining > 0)
+		{
+			// Refresh the read-ahead once the position is halfway into the last window
+			if (input->position + ReadAheadBytes / 2 >= input->prefetchedUntil)
+			{
+				input->file->Prefetch(input->position, ReadAheadBytes);
+				input->prefetchedUntil = input->position + ReadAheadBytes;
+			}
+
+			int count = (int)std::min<int64_t>(size, remaining);
+			if (input->file->Copy(buffer, input->position, count))
+			{
+				input->position += count;
+				return count;
+			}
+		}
+
+		// Truncated under the mapping, or grown past it
+		input->fileChanged = true;
+	}
+
+	int count = input->file->ReadAt(buffer, input->position, size);
+	if (count == 0)
+		return AVERROR_EOF;
+	if (count < 0)
+		return AVERROR(-count);
+
+	input->position += count;
+	return count;
+}
+
+int64_t MappedInput::Seek(void* opaque, int64_t offset, int whence)
+{
+	MappedInput* input = (MappedInput*)opaque;
+
+	// Only questions about the end of the file need to know whether it has moved
+	if (whence & AVSEEK_SIZE)
+		return input->CurrentSize();
+
+	int64_t size = input->fileChanged ? input->file->GetCurrentSize() : input->file->GetSize();
+
+	int64_t target;
+	switch (whence & ~AVSEEK_FORCE)
+	{
+	case SEEK_SET: target = offset; break;
+	case SEEK_CUR: target = input->position + offset; break;
+	case SEEK_END: size = input->CurrentSize(); target = size + offset; break;
+	default: return AVERROR(EINVAL);
+	}
+
+	if (target > size && !input->fileChanged)
+		size = input->CurrentSize();
+
+	if (target < 0 || target > size)
+		return AVERROR(EINVAL);
+
+	// A jump outside the prefetched window starts a new one at the next read
+	if (target < input->position || target >= input->prefetchedUntil)
+		input->prefetchedUntil = 0;
+
+	input->position = target;
+	return target;
+}
@@ -0,0 +1,341 @@
+#include "MediaSource.h"
+#include "ProbeCache.h"
+#include "Telemetry.h"
+
+#include <cstring>
+#include <chrono>
+
+MediaSource::MediaSource()
+{
+	auto notify = [this]() {
+		std::lock_guard<std::mutex> lock(mutex);
+		cond.notify_all();
+	};
+
+	videoQueue.onDrain = notify;
+	audioQueue.onDrain = notify;
+}
+
+MediaSource::~MediaSource()
+{
+	Close();
+}
+
+bool MediaSource::Open(const char* filename)
+{
+	Close();
+
+	// Suppress unnecessary FFmpeg warnings
+	av_log_set_level(AV_LOG_ERROR);
+
+	auto probeStart = std::chrono::steady_clock::now();
+
+	// A file probed before only needs a short look; the cache fills in the rest
+	ProbeCache probeCache;
+	probeCached = probeCache.Load(filename) && OpenInput(filename, &probeCache);
+
+	if (!probeCached)
+	{
+		if (!OpenInput(filename, nullptr))
+			return false;
+
+		probeCache.Save(filename, avFormatCTX);
+	}
+
+	probeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - probeStart).count();
+
+	if (readAheadInput.IsAttached())
+		readAheadInput.SizeWindow(avFormatCTX->bit_rate);
+
+	videoStreamIndex = -1;
+	audioStreamIndex = -1;
+
+	for (unsigned int i = 0; i < avFormatCTX->nb_streams; i++)
+	{
+		AVCodecParameters* avCodecParams = avFormatCTX->streams[i]->codecpar;
+
+		if (!avcodec_find_decoder(avCodecParams->codec_id))
+			continue;
+
+		if (avCodecParams->codec_type == AVMEDIA_TYPE_VIDEO && videoStreamIndex == -1)
+			videoStreamIndex = i;
+		else if (avCodecParams->codec_type == AVMEDIA_TYPE_AUDIO && audioStreamIndex == -1)
+			audioStreamIndex = i;
+	}
+
+	if (videoStreamIndex == -1 && audioStreamIndex == -1)
+		return false;
+
+	// Let the demuxer skip everything we never decode
+	for (unsigned int i = 0; i < avFormatCTX->nb_streams; i++)
+	{
+		if ((int)i != videoStreamIndex && (int)i != audioStreamIndex)
+			avFormatCTX->streams[i]->discard = AVDISCARD_ALL;
+	}
+
+	avPacket = av_packet_alloc();
+	if (!avPacket)
+		return false;
+
+	keyframeIndex.Open(filename, videoStreamIndex);
+
+	return true;
+}
+
+bool MediaSource::OpenInput(const char* filename, const ProbeCache* probeCache)
+{
+	if (avFormatCTX)
+		avformat_close_input(&avFormatCTX);
+	mappedInput.Close();
+	readAheadInput.Close();
+
+	avFormatCTX = avformat_alloc_context();
+	if (!avFormatCTX)
+		return false;
+
+	// Local files are read through a shared mapping, or with asynchronous read-ahead where storage
+	// is slow enough for single reads to stall the demuxer; anything else keeps FFmpeg's protocols
+	if (!ReadAheadInput::Wanted(filename, readAheadOptions) || !readAheadInput.Attach(avFormatCTX, filename, readAheadOptions))
+		mappedInput.Attach(avFormatCTX, filename);
+
+	const AVInputFormat* inputFormat = nullptr;
+	if (probeCache)
+	{
+		inputFormat = probeCache->GetInputFormat();
+		avFormatCTX->probesize = ProbeCache::ShortProbeSize;
+		avFormatCTX->max_analyze_duration = ProbeCache::ShortAnalyzeDuration;
+	}
+
+	// avformat_open_input frees the context on failure
+	if (avformat_open_input(&avFormatCTX, filename, inputFormat, nullptr) != 0)
+	{
+		avFormatCTX = nullptr;
+		return false;
+	}
+
+	if (avformat_find_stream_info(avFormatCTX, nullptr) < 0)
+		return false;
+
+	return !probeCache || probeCache->Apply(avFormatCTX);
+}
+
+void MediaSource::Start()
+{
+	if (running || !avFormatCTX)
+		return;
+
+	running = true;
+	demuxThread = std::thread(&MediaSource::DemuxLoop, this);
+}
+
+void MediaSource::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	cond.notify_all();
+
+	if (demuxThread.joinable())
+		demuxThread.join();
+}
+
+bool MediaSource::QueuesFull() const
+{
+	if ((videoStreamIndex >= 0 && videoQueue.IsOverLimit()) || (audioStreamIndex >= 0 && audioQueue.IsOverLimit()))
+		return true;
+
+	if (videoStreamIndex >= 0 && !videoQueue.IsFull())
+		return false;
+
+	if (audioStreamIndex >= 0 && !audioQueue.IsFull())
+		return false;
+
+	return true;
+}
+
+void MediaSource::DisableAudio()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (audioStreamIndex < 0)
+		return;
+
+	avFormatCTX->streams[audioStreamIndex]->discard = AVDISCARD_ALL;
+	audioStreamIndex = -1;
+	audioQueue.Flush();
+
+	// Video alone may now be below its limits
+	cond.notify_all();
+}
+
+void MediaSource::FlushQueues()
+{
+	videoQueue.Flush();
+	audioQueue.Flush();
+}
+
+bool MediaSource::Seek(double targetTime)
+{
+	if (!avFormatCTX)
+		return false;
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if (!running)
+	{
+		seekTarget = targetTime;
+		seekRequested = true;
+		lock.unlock();
+		DemuxLoop();
+		return seekSucceeded;
+	}
+
+	seekTarget = targetTime;
+	seekRequested = true;
+	cond.notify_all();
+
+	cond.wait(lock, [this]() { return !seekRequested || !running; });
+	return seekSucceeded;
+}
+
+bool MediaSource::SeekDemuxer(double targetTime)
+{
+	int streamIndex = videoStreamIndex >= 0 ? videoStreamIndex : audioStreamIndex;
+	AVRational timeBase = avFormatCTX->streams[streamIndex]->time_base;
+	int64_t timestamp = (int64_t)(targetTime / av_q2d(timeBase));
+
+	const KeyframeIndex::Entry* keyframe = streamIndex == videoStreamIndex ? keyframeIndex.Find(timestamp) : nullptr;
+
+	if (keyframe)
+	{
+		mappedInput.Prefetch(keyframe->position);
+
+		// Timestamp seeks in TS-like containers are a bisection over the file; go straight to the GOP
+		int formatFlags = avFormatCTX->iformat->flags;
+		if (keyframe->position >= 0 && (formatFlags & AVFMT_TS_DISCONT) && !(formatFlags & AVFMT_NO_BYTE_SEEK))
+		{
+			if (av_seek_frame(avFormatCTX, -1, keyframe->position, AVSEEK_FLAG_BYTE) >= 0)
+				return true;
+		}
+
+		timestamp = keyframe->pts;
+	}
+
+	return av_seek_frame(avFormatCTX, streamIndex, timestamp, AVSEEK_FLAG_BACKWARD) >= 0;
+}
+
+void MediaSource::DemuxLoop()
+{
+	Telemetry::SetThreadName("demux");
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			if (seekRequested)
+			{
+				seekSucceeded = SeekDemuxer(seekTarget);
+				FlushQueues();
+				endOfFile = false;
+				seekRequested = false;
+				cond.notify_all();
+			}
+
+			if (!running)
+				break;
+
+			cond.wait(lock, [this]() {
+				return !running || seekRequested || (!endOfFile && !QueuesFull());
+			});
+
+			if (!running)
+				break;
+
+			if (seekRequested)
+				continue;
+		}
+
+		auto readStart = std::chrono::steady_clock::now();
+		int64_t spanStart = Telemetry::Begin();
+		int ret = av_read_frame(avFormatCTX, avPacket);
+		Telemetry::End("av_read_frame", spanStart);
+		readNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - readStart).count();
+
+		if (ret < 0)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			endOfFile = true;
+			videoQueue.SetEOF(true);
+			audioQueue.SetEOF(true);
+			continue;
+		}
+
+		packetsRead++;
+		bytesRead += avPacket->size;
+
+		if (avPacket->stream_index == videoStreamIndex)
+			videoQueue.Push(avPacket);
+		else if (avPacket->stream_index == audioStreamIndex)
+			audioQueue.Push(avPacket);
+
+		av_packet_unref(avPacket);
+	}
+}
+
+DemuxStats MediaSource::GetDemuxStats() const
+{
+	DemuxStats stats;
+	stats.packets = packetsRead;
+	stats.bytes = bytesRead;
+	stats.readSeconds = readNanoseconds * 1e-9;
+	return stats;
+}
+
+bool MediaSource::SameCodecParameters(const AVCodecParameters* a, const AVCodecParameters* b)
+{
+	if (a->codec_type != b->codec_type || a->codec_id != b->codec_id || a->format != b->format ||
+		a->profile != b->profile || a->extradata_size != b->extradata_size)
+		return false;
+
+	if (a->extradata_size > 0 && memcmp(a->extradata, b->extradata, a->extradata_size) != 0)
+		return false;
+
+	if (a->codec_type == AVMEDIA_TYPE_VIDEO)
+		return a->width == b->width && a->height == b->height;
+
+	return a->sample_rate == b->sample_rate && av_channel_layout_compare(&a->ch_layout, &b->ch_layout) == 0;
+}
+
+void MediaSource::Close()
+{
+	Stop();
+	keyframeIndex.Close();
+	FlushQueues();
+
+	if (avPacket)
+	{
+		av_packet_free(&avPacket);
+		avPacket = nullptr;
+	}
+
+	if (avFormatCTX)
+	{
+		avformat_close_input(&avFormatCTX);
+		avFormatCTX = nullptr;
+	}
+	mappedInput.Close();
+	readAheadInput.Close();
+
+	videoStreamIndex = -1;
+	audioStreamIndex = -1;
+	endOfFile = false;
+	seekRequested = false;
+	probeCached = false;
+	probeSeconds = 0.0;
+	packetsRead = 0;
+	bytesRead = 0;
+	readNanoseconds = 0;
+}
@@ -0,0 +1,108 @@
+#include "PacketQueue.h"
+
+PacketQueue::PacketQueue(size_t capacity)
+	: capacity(capacity)
+{
+}
+
+PacketQueue::~PacketQueue()
+{
+	Flush();
+}
+
+void PacketQueue::Push(AVPacket* packet)
+{
+	AVPacket* queued = av_packet_alloc();
+	if (!queued)
+		return;
+
+	av_packet_move_ref(queued, packet);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		packets.push_back(queued);
+		bytes += queued->size;
+	}
+	cond.notify_one();
+}
+
+bool PacketQueue::Pop(AVPacket* packet)
+{
+	AVPacket* queued = nullptr;
+	bool drained = false;
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [this]() { return aborted || endOfStream || !packets.empty(); });
+
+		if (aborted || packets.empty())
+			return false;
+
+		queued = packets.front();
+		packets.pop_front();
+		bytes -= queued->size;
+		drained = packets.size() < capacity;
+	}
+
+	av_packet_move_ref(packet, queued);
+	av_packet_free(&queued);
+
+	if (drained && onDrain)
+		onDrain();
+
+	return true;
+}
+
+void PacketQueue::Flush()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (AVPacket* queued : packets)
+		av_packet_free(&queued);
+
+	packets.clear();
+	bytes = 0;
+	endOfStream = false;
+}
+
+void PacketQueue::SetEOF(bool eof)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		endOfStream = eof;
+	}
+	cond.notify_all();
+}
+
+void PacketQueue::Abort(bool abort)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		aborted = abort;
+	}
+	cond.notify_all();
+}
+
+bool PacketQueue::IsEndOfStream() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return endOfStream && !aborted && packets.empty();
+}
+
+bool PacketQueue::IsFull() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return packets.size() >= capacity;
+}
+
+bool PacketQueue::IsOverLimit() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return packets.size() >= capacity * HardLimitFactor || bytes >= HardLimitBytes;
+}
+
+size_t PacketQueue::Size() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return packets.size();
+}
@@ -0,0 +1,176 @@
+#include "Playlist.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+
+// Longest Start waits for a first frame before letting playback carry on without it
+static const double FirstFrameTimeout = 5.0;
+
+PlaylistItem::PlaylistItem() {}
+
+PlaylistItem::~PlaylistItem()
+{
+	Close();
+}
+
+void PlaylistItem::Stop()
+{
+	WaitPrepared();
+	ready = false;
+	usesFrameStorage = false;
+
+	// Readers block on the source's queues, so they stop before it is reopened
+	video.StopDecoding();
+	audio.StopDecoding();
+	source.Stop();
+}
+
+bool PlaylistItem::Open(const std::string& filePath, AudioOutput* output, const PlaybackSettings& settings)
+{
+	Stop();
+	path = filePath;
+	openStart = std::chrono::steady_clock::now();
+
+	source.SetReadAhead(settings.readAhead);
+	if (!source.Open(path.c_str()))
+	{
+		std::cout << "Couldn't open " << path << "\n";
+		return false;
+	}
+
+	if (!video.Open(&source, settings.decodeOptions))
+	{
+		std::cout << "Couldn't open video in " << path << "\n";
+		return false;
+	}
+
+	hasAudio = audio.Open(&source, output);
+	if (!hasAudio)
+	{
+		std::cout << "Warning: No audio stream found or couldn't open audio in " << path << "\n";
+	}
+
+	if (!thumbnails.Open(path.c_str()))
+	{
+		std::cout << "Warning: Timeline thumbnails unavailable\n";
+	}
+
+	return true;
+}
+
+void PlaylistItem::Start(const PlaybackSettings& settings)
+{
+	usesFrameStorage = settings.frameStorage && video.GetFrameSize() <= settings.storageFrameSize;
+	if (usesFrameStorage)
+		video.UseFrameStorage(settings.frameStorage, settings.storageSlots);
+
+	playbackRate = settings.playbackRate;
+	video.SetPlaybackRate(settings.playbackRate, settings.refreshInterval);
+	if (hasAudio)
+		audio.SetPlaybackRate(settings.playbackRate);
+
+	source.Start();
+	video.StartDecoding();
+
+	if (hasAudio && !audio.PrefillBuffer(settings.audioPrefillSeconds))
+	{
+		std::cout << "Warning: Failed to prefill audio buffer\n";
+	}
+
+	auto waitStart = std::chrono::steady_clock::now();
+	while (!video.PeekFrame() && !video.IsFinished() &&
+		   std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count() < FirstFrameTimeout)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	firstFrameSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - openStart).count();
+
+	if (hasAudio)
+		audio.StartDecoding();
+}
+
+void PlaylistItem::PrintOpenTiming() const
+{
+	printf("%s: first frame %.0f ms after open, probing took %.0f ms (%s)\n",
+		   path.c_str(), 1000.0 * firstFrameSeconds, 1000.0 * source.GetProbeSeconds(),
+		   source.WasProbeCached() ? "cached" : "full probe");
+}
+
+void PlaylistItem::Prepare(const std::string& filePath, AudioOutput* output, const PlaybackSettings& settings)
+{
+	Stop();
+	preparing = true;
+
+	// The atlas texture can only be released on the GL thread
+	thumbnails.Close();
+
+	prepareThread = std::thread([=]() {
+		if (Open(filePath, output, settings))
+		{
+			Start(settings);
+			ready = true;
+		}
+		preparing = false;
+	});
+}
+
+void PlaylistItem::WaitPrepared()
+{
+	if (prepareThread.joinable() && prepareThread.get_id() != std::this_thread::get_id())
+		prepareThread.join();
+}
+
+void PlaylistItem::Close()
+{
+	Stop();
+
+	thumbnails.Close();
+	video.Close();
+	audio.Close();
+	source.Close();
+}
+
+void Playlist::Add(const std::string& path)
+{
+	size_t dot = path.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+	for (char& c : extension)
+		c = (char)tolower(c);
+
+	if (extension == "m3u" || extension == "m3u8")
+		AddM3U(path);
+	else
+		paths.push_back(path);
+}
+
+void Playlist::AddM3U(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cout << "Couldn't read playlist " << path << "\n";
+		return;
+	}
+
+	size_t slash = path.find_last_of('/');
+	std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t'))
+			line.pop_back();
+
+		size_t begin = line.find_first_not_of(" \t");
+		if (begin == std::string::npos || line[begin] == '#')
+			continue;
+		line = line.substr(begin);
+
+		// Entries are relative to the list unless absolute or a URL
+		bool absolute = line[0] == '/' || line.find("://") != std::string::npos;
+		paths.push_back(absolute ? line : directory + line);
+	}
+}
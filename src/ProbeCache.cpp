@@ -0,0 +1,217 @@
+#include "ProbeCache.h"
+#include "CacheFile.h"
+
+#include <cstdio>
+#include <cstring>
+
+extern "C"
+{
+#include <libavutil/mem.h>
+}
+
+static const char ProbeCacheMagic[4] = { 'P', 'R', 'B', 'C' };
+static const uint32_t ProbeCacheVersion = 1;
+
+bool ProbeCache::Load(const char* filename)
+{
+	loaded = false;
+	streams.clear();
+	extradata.clear();
+
+	int64_t fileSize, modifiedTime;
+	if (!CacheFile::GetFileStamp(filename, &fileSize, &modifiedTime))
+		return false;
+
+	std::string cachePath = CacheFile::PathFor(filename, "probe");
+	if (cachePath.empty())
+		return false;
+
+	FILE* file = fopen(cachePath.c_str(), "rb");
+	if (!file)
+		return false;
+
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+				 memcmp(header.magic, ProbeCacheMagic, 4) == 0 &&
+				 header.version == ProbeCacheVersion &&
+				 header.fileSize == fileSize &&
+				 header.modifiedTime == modifiedTime &&
+				 header.streamCount > 0 && header.streamCount <= 1024;
+
+	for (int64_t i = 0; valid && i < header.streamCount; i++)
+	{
+		StreamRecord record;
+		valid = fread(&record, sizeof(record), 1, file) == 1 &&
+				record.extradataSize >= 0 && record.extradataSize <= (1 << 24);
+		if (!valid)
+			break;
+
+		std::vector<uint8_t> data((size_t)record.extradataSize);
+		valid = data.empty() || fread(data.data(), 1, data.size(), file) == data.size();
+
+		streams.push_back(record);
+		extradata.push_back(std::move(data));
+	}
+
+	fclose(file);
+
+	header.formatName[sizeof(header.formatName) - 1] = '\0';
+	loaded = valid;
+	return loaded;
+}
+
+const AVInputFormat* ProbeCache::GetInputFormat() const
+{
+	return loaded ? av_find_input_format(header.formatName) : nullptr;
+}
+
+bool ProbeCache::Apply(AVFormatContext* formatCTX) const
+{
+	if (!loaded || formatCTX->nb_streams != (unsigned int)streams.size())
+		return false;
+
+	for (size_t i = 0; i < streams.size(); i++)
+	{
+		const AVStream* stream = formatCTX->streams[i];
+		const StreamRecord& record = streams[i];
+
+		if (stream->codecpar->codec_type != record.codecType || stream->codecpar->codec_id != record.codecId ||
+			av_cmp_q(stream->time_base, record.timeBase) != 0)
+			return false;
+	}
+
+	for (size_t i = 0; i < streams.size(); i++)
+	{
+		AVStream* stream = formatCTX->streams[i];
+		AVCodecParameters* params = stream->codecpar;
+		const StreamRecord& record = streams[i];
+
+		if (params->codec_tag == 0)
+			params->codec_tag = record.codecTag;
+		if (params->format < 0)
+			params->format = record.format;
+		if (params->profile == AV_PROFILE_UNKNOWN)
+			params->profile = record.profile;
+		if (params->level == AV_LEVEL_UNKNOWN)
+			params->level = record.level;
+
+		if (params->extradata_size == 0 && !extradata[i].empty())
+		{
+			params->extradata = (uint8_t*)av_mallocz(extradata[i].size() + AV_INPUT_BUFFER_PADDING_SIZE);
+			if (params->extradata)
+			{
+				memcpy(params->extradata, extradata[i].data(), extradata[i].size());
+				params->extradata_size = (int)extradata[i].size();
+			}
+		}
+
+		if (params->codec_type == AVMEDIA_TYPE_VIDEO)
+		{
+			if (params->width == 0 || params->height == 0)
+			{
+				params->width = record.width;
+				params->height = record.height;
+			}
+			if (params->sample_aspect_ratio.num == 0)
+				params->sample_aspect_ratio = record.sampleAspectRatio;
+		}
+		else if (params->codec_type == AVMEDIA_TYPE_AUDIO)
+		{
+			if (params->sample_rate == 0)
+				params->sample_rate = record.sampleRate;
+			if (params->frame_size == 0)
+				params->frame_size = record.frameSize;
+
+			if (params->ch_layout.nb_channels == 0 && record.channels > 0)
+			{
+				if (record.channelMask)
+					av_channel_layout_from_mask(&params->ch_layout, record.channelMask);
+				else
+					av_channel_layout_default(&params->ch_layout, record.channels);
+			}
+		}
+
+		// Timing is estimated from the packets read, so the full probe's figures are better
+		stream->avg_frame_rate = record.averageFrameRate;
+		stream->r_frame_rate = record.realFrameRate;
+		stream->start_time = record.startTime;
+		stream->duration = record.duration;
+		if (stream->nb_frames == 0)
+			stream->nb_frames = record.frameCount;
+	}
+
+	formatCTX->start_time = header.startTime;
+	formatCTX->duration = header.duration;
+
+	return true;
+}
+
+void ProbeCache::Save(const char* filename, const AVFormatContext* formatCTX)
+{
+	Header saved = {};
+	if (!CacheFile::GetFileStamp(filename, &saved.fileSize, &saved.modifiedTime) || formatCTX->nb_streams == 0)
+		return;
+
+	std::string cachePath = CacheFile::PathFor(filename, "probe");
+	if (cachePath.empty())
+		return;
+
+	memcpy(saved.magic, ProbeCacheMagic, 4);
+	saved.version = ProbeCacheVersion;
+	saved.startTime = formatCTX->start_time;
+	saved.duration = formatCTX->duration;
+	saved.streamCount = formatCTX->nb_streams;
+
+	// Demuxer names list their aliases ("mov,mp4,m4a,..."); the first one finds it again
+	const char* formatName = formatCTX->iformat->name;
+	size_t nameLength = strcspn(formatName, ",");
+	if (nameLength >= sizeof(saved.formatName))
+		return;
+	memcpy(saved.formatName, formatName, nameLength);
+
+	std::string temporaryPath = cachePath + ".tmp";
+	FILE* file = fopen(temporaryPath.c_str(), "wb");
+	if (!file)
+		return;
+
+	bool written = fwrite(&saved, sizeof(saved), 1, file) == 1;
+
+	for (unsigned int i = 0; written && i < formatCTX->nb_streams; i++)
+	{
+		const AVStream* stream = formatCTX->streams[i];
+		const AVCodecParameters* params = stream->codecpar;
+
+		StreamRecord record = {};
+		record.codecType = params->codec_type;
+		record.codecId = params->codec_id;
+		record.codecTag = params->codec_tag;
+		record.format = params->format;
+		record.profile = params->profile;
+		record.level = params->level;
+		record.width = params->width;
+		record.height = params->height;
+		record.sampleAspectRatio = params->sample_aspect_ratio;
+		record.sampleRate = params->sample_rate;
+		record.channels = params->ch_layout.nb_channels;
+		record.channelMask = params->ch_layout.order == AV_CHANNEL_ORDER_NATIVE ? params->ch_layout.u.mask : 0;
+		record.frameSize = params->frame_size;
+		record.timeBase = stream->time_base;
+		record.averageFrameRate = stream->avg_frame_rate;
+		record.realFrameRate = stream->r_frame_rate;
+		record.startTime = stream->start_time;
+		record.duration = stream->duration;
+		record.frameCount = stream->nb_frames;
+		record.extradataSize = params->extradata_size;
+
+		written = fwrite(&record, sizeof(record), 1, file) == 1 &&
+				  (params->extradata_size == 0 ||
+				   fwrite(params->extradata, 1, params->extradata_size, file) == (size_t)params->extradata_size);
+	}
+
+	if (fclose(file) != 0 || !written)
+	{
+		remove(temporaryPath.c_str());
+		return;
+	}
+
+	rename(temporaryPath.c_str(), cachePath.c_str());
+}
@@ -0,0 +1,615 @@
+#include "ReadAheadInput.h"
+
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+extern "C"
+{
+#include <libavutil/mem.h>
+}
+
+const int64_t ReadAheadInput::BlockSize;
+
+static const int IOBufferSize = 64 * 1024;
+static const unsigned RingEntries = 128;
+static const size_t MaxInFlight = 64;
+static const int WorkerCount = 4;
+static const int64_t MaxWindowBytes = 1024LL * 1024 * 1024;
+
+// io_uring user_data tags that are not blocks
+static const uint64_t WakeTag = 0;
+static const uint64_t CancelTag = 1;
+
+// statfs types of filesystems whose reads go over the network
+static const int64_t NetworkFilesystems[] = {
+	0x6969,         // NFS
+	0x517B,         // SMB
+	0xFF534D42,     // CIFS
+	0xFE534D42,     // SMB2
+	0x65735546,     // FUSE (sshfs, rclone, ...)
+	0x00C36400,     // Ceph
+	0x01021997,     // 9p
+};
+
+ReadAheadInput::ReadAheadInput() {}
+
+ReadAheadInput::~ReadAheadInput()
+{
+	Close();
+}
+
+bool ReadAheadInput::Wanted(const char* filename, const ReadAheadOptions& options)
+{
+	if (options.mode == ReadAheadOff)
+		return false;
+	if (options.mode == ReadAheadOn)
+		return true;
+
+	struct statfs info;
+	if (statfs(filename, &info) != 0)
+		return false;
+
+	for (int64_t type : NetworkFilesystems)
+	{
+		if ((int64_t)(uint32_t)info.f_type == type)
+			return true;
+	}
+	return false;
+}
+
+bool ReadAheadInput::Attach(AVFormatContext* formatCTX, const char* filename, const ReadAheadOptions& readAheadOptions)
+{
+	Close();
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+	{
+		close(fd);
+		fd = -1;
+		return false;
+	}
+
+	uint8_t* buffer = (uint8_t*)av_malloc(IOBufferSize);
+	if (buffer)
+		ioCTX = avio_alloc_context(buffer, IOBufferSize, 0, this, &ReadAheadInput::Read, nullptr, &ReadAheadInput::Seek);
+
+	if (!ioCTX)
+	{
+		av_free(buffer);
+		close(fd);
+		fd = -1;
+		return false;
+	}
+
+	options = readAheadOptions;
+	fileSize = (int64_t)info.st_size;
+	windowBytes = std::max(options.windowBytes, BlockSize);
+	stopping = false;
+	stats = ReadAheadStats();
+
+	if (!StartRing())
+	{
+		for (int i = 0; i < WorkerCount; i++)
+			workers.emplace_back(&ReadAheadInput::WorkerLoop, this);
+	}
+	stats.usingIoUring = usingRing;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		position = 0;
+		refilledAt = -1;
+		Refill();
+	}
+
+	formatCTX->pb = ioCTX;
+	formatCTX->flags |= AVFMT_FLAG_CUSTOM_IO;
+	return true;
+}
+
+void ReadAheadInput::Close()
+{
+	if (!ioCTX)
+		return;
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+
+		for (auto& entry : blocks)
+		{
+			if (entry.second->inFlight)
+				Cancel(entry.second);
+			else
+				Recycle(entry.second);
+		}
+		blocks.clear();
+		cond.notify_all();
+
+		// Buffers may not be freed while the kernel or a worker still writes into them
+		cond.wait(lock, [this]() { return inFlight == 0; });
+	}
+
+	StopRing();
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+
+	for (Block* block : spareBlocks)
+		delete block;
+	spareBlocks.clear();
+
+	close(fd);
+	fd = -1;
+
+	av_freep(&ioCTX->buffer);
+	avio_context_free(&ioCTX);
+}
+
+void ReadAheadInput::SizeWindow(int64_t bitRate)
+{
+	if (options.windowSeconds <= 0.0 || bitRate <= 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	windowBytes = std::clamp((int64_t)(options.windowSeconds * bitRate / 8.0), 4 * BlockSize, MaxWindowBytes);
+	Refill();
+}
+
+ReadAheadStats ReadAheadInput::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	ReadAheadStats current = stats;
+	current.windowBytes = windowBytes;
+	return current;
+}
+
+void ReadAheadInput::Refill()
+{
+	// Keeps [block at position - 1, block at position + window) requested or in memory
+	int64_t first = position / BlockSize;
+	int64_t totalBlocks = (fileSize + BlockSize - 1) / BlockSize;
+	int64_t last = std::min(first + windowBytes / BlockSize, totalBlocks);
+
+	for (auto it = blocks.begin(); it != blocks.end();)
+	{
+		Block* block = it->second;
+		if (block->number >= first - 1 && block->number < last)
+		{
+			++it;
+			continue;
+		}
+
+		if (block->inFlight)
+			Cancel(block);
+		else
+			Recycle(block);
+		it = blocks.erase(it);
+	}
+
+	for (int64_t number = first; number < last && inFlight < MaxInFlight; number++)
+	{
+		if (blocks.count(number))
+			continue;
+
+		Block* block;
+		if (!spareBlocks.empty())
+		{
+			block = spareBlocks.back();
+			spareBlocks.pop_back();
+		}
+		else
+		{
+			block = new Block();
+			block->data.resize(BlockSize);
+		}
+
+		block->number = number;
+		block->length = std::min(BlockSize, fileSize - number * BlockSize);
+		blocks[number] = block;
+		Submit(block);
+	}
+
+	refilledAt = first;
+}
+
+void ReadAheadInput::Submit(Block* block)
+{
+	block->inFlight = true;
+	inFlight++;
+
+	if (usingRing)
+	{
+		// A read the kernel would not take fails now, for the demuxer's pread; this is inside Refill already
+		int error = SubmitRing(block);
+		if (error < 0)
+			Complete(block, error, false);
+	}
+	else
+	{
+		queued.push_back(block);
+		cond.notify_all();
+	}
+}
+
+void ReadAheadInput::Cancel(Block* block)
+{
+	block->cancelled = true;
+	stats.cancelled++;
+
+	if (usingRing)
+	{
+		CancelRing(block);
+		return;
+	}
+
+	// Still queued means no worker has it yet, so it can go straight back
+	auto found = std::find(queued.begin(), queued.end(), block);
+	if (found != queued.end())
+	{
+		queued.erase(found);
+		inFlight--;
+		Recycle(block);
+	}
+}
+
+void ReadAheadInput::Complete(Block* block, int64_t result, bool refill)
+{
+	inFlight--;
+	block->inFlight = false;
+
+	if (block->cancelled)
+	{
+		Recycle(block);
+	}
+	else if (result != block->length)
+	{
+		// Short or failed reads are redone synchronously when the demuxer gets there
+		block->failed = true;
+	}
+	else
+	{
+		stats.bytesRead += result;
+	}
+
+	cond.notify_all();
+
+	if (refill && !stopping)
+		Refill();
+}
+
+void ReadAheadInput::Recycle(Block* block)
+{
+	block->inFlight = false;
+	block->cancelled = false;
+	block->failed = false;
+	spareBlocks.push_back(block);
+}
+
+int ReadAheadInput::Read(void* opaque, uint8_t* buffer, int size)
+{
+	ReadAheadInput* input = (ReadAheadInput*)opaque;
+	std::unique_lock<std::mutex> lock(input->mutex);
+
+	if (input->position >= input->fileSize)
+		return AVERROR_EOF;
+
+	int64_t number = input->position / BlockSize;
+	if (number != input->refilledAt)
+		input->Refill();
+
+	auto found = input->blocks.find(number);
+	Block* block = found != input->blocks.end() ? found->second : nullptr;
+
+	if (block && !block->inFlight)
+	{
+		input->stats.hits++;
+	}
+	else
+	{
+		auto waitStart = std::chrono::steady_clock::now();
+
+		if (block)
+		{
+			input->stats.stalls++;
+			input->cond.wait(lock, [block]() { return !block->inFlight; });
+		}
+		else
+		{
+			input->stats.misses++;
+		}
+
+		input->stats.stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+	}
+
+	if (!block || block->failed)
+	{
+		int64_t offset = input->position;
+		int count = (int)std::min<int64_t>(size, input->fileSize - offset);
+
+		lock.unlock();
+		ssize_t result = pread(input->fd, buffer, count, offset);
+		lock.lock();
+
+		if (result < 0)
+			return AVERROR(errno);
+		if (result == 0)
+			return AVERROR_EOF;
+
+		input->position += result;
+		input->stats.bytesRead += result;
+		return (int)result;
+	}
+
+	int64_t offsetInBlock = input->position - number * BlockSize;
+	int count = (int)std::min<int64_t>(size, block->length - offsetInBlock);
+	memcpy(buffer, block->data.data() + offsetInBlock, count);
+	input->position += count;
+	return count;
+}
+
+int64_t ReadAheadInput::Seek(void* opaque, int64_t offset, int whence)
+{
+	ReadAheadInput* input = (ReadAheadInput*)opaque;
+	std::lock_guard<std::mutex> lock(input->mutex);
+
+	if (whence & AVSEEK_SIZE)
+		return input->fileSize;
+
+	int64_t target;
+	switch (whence & ~AVSEEK_FORCE)
+	{
+	case SEEK_SET: target = offset; break;
+	case SEEK_CUR: target = input->position + offset; break;
+	case SEEK_END: target = input->fileSize + offset; break;
+	default: return AVERROR(EINVAL);
+	}
+
+	if (target < 0 || target > input->fileSize)
+		return AVERROR(EINVAL);
+
+	input->position = target;
+
+	// Landing outside the window cancels what is in flight and re-targets it here
+	if (!input->blocks.count(target / BlockSize))
+		input->Refill();
+
+	return target;
+}
+
+// Kernels 5.1 to 5.5 set up rings without IORING_OP_READ, where every block would fail
+// over to pread; they also predate the probe, so a failed probe counts as unsupported
+static bool RingSupportsReads(int ringFd)
+{
+	const unsigned probeOps = 256;
+	std::vector<uint8_t> storage(sizeof(io_uring_probe) + probeOps * sizeof(io_uring_probe_op), 0);
+	io_uring_probe* probe = (io_uring_probe*)storage.data();
+
+	if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, probeOps) < 0)
+		return false;
+
+	for (int opcode : { IORING_OP_READ, IORING_OP_ASYNC_CANCEL })
+	{
+		if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+			return false;
+	}
+	return true;
+}
+
+bool ReadAheadInput::StartRing()
+{
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	ringFd = (int)syscall(__NR_io_uring_setup, RingEntries, &params);
+	if (ringFd < 0)
+		return false;
+
+	if (!RingSupportsReads(ringFd))
+	{
+		close(ringFd);
+		ringFd = -1;
+		return false;
+	}
+
+	sqMappingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqMappingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+	bool singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (singleMapping)
+		sqMappingSize = cqMappingSize = std::max(sqMappingSize, cqMappingSize);
+
+	sqMapping = mmap(nullptr, sqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	if (sqMapping == MAP_FAILED)
+		sqMapping = nullptr;
+
+	cqMapping = singleMapping ? sqMapping :
+		mmap(nullptr, cqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+	if (cqMapping == MAP_FAILED)
+		cqMapping = nullptr;
+
+	sqeMappingSize = params.sq_entries * sizeof(io_uring_sqe);
+	sqeMapping = mmap(nullptr, sqeMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if (sqeMapping == MAP_FAILED)
+		sqeMapping = nullptr;
+
+	if (!sqMapping || !cqMapping || !sqeMapping)
+	{
+		StopRing();
+		return false;
+	}
+
+	uint8_t* sq = (uint8_t*)sqMapping;
+	uint8_t* cq = (uint8_t*)cqMapping;
+	sqHead = (unsigned*)(sq + params.sq_off.head);
+	sqTail = (unsigned*)(sq + params.sq_off.tail);
+	sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+	sqArray = (unsigned*)(sq + params.sq_off.array);
+	cqHead = (unsigned*)(cq + params.cq_off.head);
+	cqTail = (unsigned*)(cq + params.cq_off.tail);
+	cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+	cqes = cq + params.cq_off.cqes;
+
+	usingRing = true;
+	reapThread = std::thread(&ReadAheadInput::ReapLoop, this);
+	return true;
+}
+
+void ReadAheadInput::StopRing()
+{
+	if (reapThread.joinable())
+	{
+		// A no-op completion with the wake tag ends the reaper. Nothing is in flight by now,
+		// so a refusal can only be transient
+		io_uring_sqe sqe;
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_NOP;
+		sqe.user_data = WakeTag;
+
+		while (true)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (PushRing(sqe) == 0)
+					break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		reapThread.join();
+	}
+
+	if (sqeMapping)
+		munmap(sqeMapping, sqeMappingSize);
+	if (cqMapping && cqMapping != sqMapping)
+		munmap(cqMapping, cqMappingSize);
+	if (sqMapping)
+		munmap(sqMapping, sqMappingSize);
+	if (ringFd >= 0)
+		close(ringFd);
+
+	sqeMapping = cqMapping = sqMapping = nullptr;
+	ringFd = -1;
+	usingRing = false;
+}
+
+int ReadAheadInput::PushRing(const io_uring_sqe& entry)
+{
+	unsigned tail = *sqTail;
+	unsigned index = tail & *sqMask;
+
+	((io_uring_sqe*)sqeMapping)[index] = entry;
+	sqArray[index] = index;
+	__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+	int submitted;
+	do
+		submitted = (int)syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, nullptr, 0);
+	while (submitted < 0 && errno == EINTR);
+
+	if (submitted > 0)
+		return 0;
+
+	int error = submitted < 0 ? -errno : -EAGAIN;
+
+	// Without SQPOLL the kernel only takes entries inside io_uring_enter, so one it refused
+	// can be taken back; left in the ring it would never be submitted, or be submitted late
+	if (__atomic_load_n(sqHead, __ATOMIC_ACQUIRE) == tail)
+	{
+		__atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+		return error;
+	}
+	return 0;
+}
+
+int ReadAheadInput::SubmitRing(Block* block)
+{
+	io_uring_sqe sqe;
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = IORING_OP_READ;
+	sqe.fd = fd;
+	sqe.off = (uint64_t)(block->number * BlockSize);
+	sqe.addr = (uint64_t)(uintptr_t)block->data.data();
+	sqe.len = (unsigned)block->length;
+	sqe.user_data = (uint64_t)(uintptr_t)block;
+
+	return PushRing(sqe);
+}
+
+void ReadAheadInput::CancelRing(Block* block)
+{
+	io_uring_sqe sqe;
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = IORING_OP_ASYNC_CANCEL;
+	sqe.addr = (uint64_t)(uintptr_t)block;
+	sqe.user_data = CancelTag;
+
+	// Uncancelled, the read still completes and the block is recycled then
+	PushRing(sqe);
+}
+
+void ReadAheadInput::ReapLoop()
+{
+	bool woken = false;
+
+	while (!woken)
+	{
+		syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+		unsigned head = *cqHead;
+		unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+		while (head != tail)
+		{
+			const io_uring_cqe* cqe = &((const io_uring_cqe*)cqes)[head & *cqMask];
+			uint64_t tag = cqe->user_data;
+			int result = cqe->res;
+			head++;
+
+			if (tag == WakeTag)
+			{
+				woken = true;
+			}
+			else if (tag != CancelTag)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				Complete((Block*)(uintptr_t)tag, result);
+			}
+		}
+
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+	}
+}
+
+void ReadAheadInput::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true)
+	{
+		cond.wait(lock, [this]() { return stopping || !queued.empty(); });
+		if (queued.empty())
+			break;
+
+		Block* block = queued.front();
+		queued.pop_front();
+
+		lock.unlock();
+		ssize_t result = pread(fd, block->data.data(), block->length, block->number * BlockSize);
+		lock.lock();
+
+		Complete(block, result < 0 ? -errno : result);
+	}
+}
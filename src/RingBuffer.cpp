@@ -0,0 +1,71 @@
+#include "RingBuffer.h"
+
+#include <cstring>
+#include <algorithm>
+
+RingBuffer::RingBuffer() {}
+
+void RingBuffer::Init(size_t capacity)
+{
+	size_t size = 1;
+	while (size < capacity)
+		size <<= 1;
+
+	buffer.assign(size, 0);
+	mask = size - 1;
+	Reset();
+}
+
+size_t RingBuffer::Write(const uint8_t* data, size_t size)
+{
+	size_t write = writePos.load(std::memory_order_relaxed);
+	size_t read = readPos.load(std::memory_order_acquire);
+
+	size = std::min(size, buffer.size() - (write - read));
+	if (size == 0)
+		return 0;
+
+	size_t offset = write & mask;
+	size_t first = std::min(size, buffer.size() - offset);
+
+	memcpy(&buffer[offset], data, first);
+	memcpy(&buffer[0], data + first, size - first);
+
+	writePos.store(write + size, std::memory_order_release);
+	return size;
+}
+
+size_t RingBuffer::Read(uint8_t* data, size_t size)
+{
+	size_t read = readPos.load(std::memory_order_relaxed);
+	size_t write = writePos.load(std::memory_order_acquire);
+
+	size = std::min(size, write - read);
+	if (size == 0)
+		return 0;
+
+	size_t offset = read & mask;
+	size_t first = std::min(size, buffer.size() - offset);
+
+	memcpy(data, &buffer[offset], first);
+	memcpy(data + first, &buffer[0], size - first);
+
+	readPos.store(read + size, std::memory_order_release);
+	return size;
+}
+
+size_t RingBuffer::AvailableRead() const
+{
+	return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_acquire);
+}
+
+size_t RingBuffer::AvailableWrite() const
+{
+	return buffer.size() - AvailableRead();
+}
+
+void RingBuffer::Reset()
+{
+	readPos.store(0, std::memory_order_relaxed);
+	writePos.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,354 @@
+#include "Telemetry.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <map>
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+const size_t Telemetry::DefaultEventsPerThread;
+std::atomic<bool> Telemetry::enabled{ false };
+
+enum EventKind
+{
+	EventSpan = 0,
+	EventValue,
+	EventMark,
+};
+
+struct TelemetryEvent
+{
+	const char* name;
+	int64_t time;       // steady clock nanoseconds; the start for spans
+	double amount;      // span length in nanoseconds, or the sample
+	int kind;
+};
+
+// Log-linear buckets, 8 per octave from 2^-10 to 2^30 (milliseconds for spans), plus under- and overflow
+static const int OctaveSteps = 8;
+static const int MinOctave = -10;
+static const int MaxOctave = 30;
+static const int BucketCount = (MaxOctave - MinOctave) * OctaveSteps + 2;
+static const int MaxSeries = 32;
+
+struct Series
+{
+	const char* name = nullptr;
+	int kind = EventSpan;
+	uint64_t count = 0;
+	double max = 0.0;
+	uint32_t buckets[BucketCount] = {};
+};
+
+struct ThreadLog
+{
+	const char* name = nullptr;
+	int lane = 0;
+	bool inUse = false;
+	std::vector<TelemetryEvent> events;     // power-of-two ring
+	std::atomic<uint64_t> written{ 0 };
+	Series series[MaxSeries];
+	int seriesCount = 0;
+};
+
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadLog>> threadLogs;
+static size_t eventCapacity = Telemetry::DefaultEventsPerThread;
+static int64_t epoch = 0;
+
+// The calling thread's log; it goes back to the registry for reuse when the thread exits
+struct ThreadHandle
+{
+	const char* name = nullptr;
+	ThreadLog* log = nullptr;
+
+	~ThreadHandle() { Release(); }
+
+	void Release()
+	{
+		if (!log)
+			return;
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		log->inUse = false;
+		log = nullptr;
+	}
+};
+
+static thread_local ThreadHandle threadHandle;
+
+static ThreadLog* AcquireLog()
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	const char* name = threadHandle.name ? threadHandle.name : "thread";
+
+	for (auto& log : threadLogs)
+	{
+		if (!log->inUse && strcmp(log->name, name) == 0)
+		{
+			log->inUse = true;
+			threadHandle.log = log.get();
+			return threadHandle.log;
+		}
+	}
+
+	std::unique_ptr<ThreadLog> log(new ThreadLog());
+	log->name = name;
+	log->lane = (int)threadLogs.size() + 1;
+	log->inUse = true;
+	log->events.resize(eventCapacity);
+
+	threadHandle.log = log.get();
+	threadLogs.push_back(std::move(log));
+	return threadHandle.log;
+}
+
+static int BucketIndex(double value)
+{
+	if (!(value >= std::ldexp(1.0, MinOctave)))
+		return 0;
+
+	// value = mantissa * 2^exponent with mantissa in [0.5, 1)
+	int exponent;
+	double mantissa = std::frexp(value, &exponent);
+	int octave = exponent - 1;
+	if (octave >= MaxOctave)
+		return BucketCount - 1;
+
+	return 1 + (octave - MinOctave) * OctaveSteps + (int)((mantissa * 2.0 - 1.0) * OctaveSteps);
+}
+
+static double BucketValue(int index)
+{
+	if (index == 0)
+		return 0.0;
+	if (index == BucketCount - 1)
+		return INFINITY;
+
+	int octave = (index - 1) / OctaveSteps + MinOctave;
+	int step = (index - 1) % OctaveSteps;
+	return std::ldexp(1.0 + (step + 0.5) / OctaveSteps, octave);
+}
+
+static void Record(const char* name, int kind, int64_t time, double amount, double magnitude)
+{
+	ThreadLog* log = threadHandle.log ? threadHandle.log : AcquireLog();
+
+	uint64_t index = log->written.load(std::memory_order_relaxed);
+	log->events[index & (log->events.size() - 1)] = { name, time, amount, kind };
+	log->written.store(index + 1, std::memory_order_release);
+
+	Series* series = nullptr;
+	for (int i = 0; i < log->seriesCount && !series; i++)
+	{
+		if (log->series[i].name == name)
+			series = &log->series[i];
+	}
+
+	if (!series)
+	{
+		// Past MaxSeries names a thread's extra ones only reach the trace
+		if (log->seriesCount == MaxSeries)
+			return;
+
+		series = &log->series[log->seriesCount++];
+		series->name = name;
+		series->kind = kind;
+	}
+
+	series->count++;
+	if (kind != EventMark)
+	{
+		series->max = std::max(series->max, magnitude);
+		series->buckets[BucketIndex(magnitude)]++;
+	}
+}
+
+void Telemetry::Enable(size_t eventsPerThread)
+{
+	size_t capacity = 1;
+	while (capacity < eventsPerThread)
+		capacity <<= 1;
+
+	eventCapacity = capacity;
+	epoch = Now();
+	enabled.store(true, std::memory_order_release);
+}
+
+int64_t Telemetry::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Telemetry::SetThreadName(const char* name)
+{
+	if (threadHandle.name == name)
+		return;
+
+	if (threadHandle.log && strcmp(threadHandle.log->name, name) != 0)
+		threadHandle.Release();
+
+	threadHandle.name = name;
+}
+
+void Telemetry::End(const char* name, int64_t start)
+{
+	if (start == 0 || !IsEnabled())
+		return;
+
+	double length = (double)(Now() - start);
+	Record(name, EventSpan, start, length, length * 1e-6);
+}
+
+void Telemetry::Value(const char* name, double value)
+{
+	if (!IsEnabled())
+		return;
+
+	Record(name, EventValue, Now(), value, std::fabs(value));
+}
+
+void Telemetry::Mark(const char* name)
+{
+	if (!IsEnabled())
+		return;
+
+	Record(name, EventMark, Now(), 0.0, 0.0);
+}
+
+bool Telemetry::WriteTrace(const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		std::cout << "Couldn't write trace to " << path << "\n";
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	bool first = true;
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	for (auto& log : threadLogs)
+	{
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				first ? "" : ",\n", log->lane, log->name);
+		first = false;
+
+		uint64_t written = log->written.load(std::memory_order_acquire);
+		uint64_t kept = std::min<uint64_t>(written, log->events.size());
+
+		for (uint64_t i = written - kept; i < written; i++)
+		{
+			const TelemetryEvent& event = log->events[i & (log->events.size() - 1)];
+			double timestamp = (event.time - epoch) * 1e-3;
+
+			if (event.kind == EventSpan)
+			{
+				fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+						event.name, log->lane, timestamp, event.amount * 1e-3);
+			}
+			else if (event.kind == EventValue)
+			{
+				fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%.6g}}",
+						event.name, log->lane, timestamp, event.amount);
+			}
+			else
+			{
+				fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f}",
+						event.name, log->lane, timestamp);
+			}
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+
+	bool written = ferror(file) == 0;
+	written = fclose(file) == 0 && written;
+	if (!written)
+		std::cout << "Couldn't write trace to " << path << "\n";
+	return written;
+}
+
+void Telemetry::PrintSummary()
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+
+	// The same name from several threads, or several runs of one, is one row
+	std::map<std::string, Series> merged;
+	uint64_t recorded = 0;
+	uint64_t overwritten = 0;
+
+	for (auto& log : threadLogs)
+	{
+		uint64_t written = log->written.load(std::memory_order_acquire);
+		recorded += written;
+		if (written > log->events.size())
+			overwritten += written - log->events.size();
+
+		for (int i = 0; i < log->seriesCount; i++)
+		{
+			const Series& series = log->series[i];
+			Series& row = merged[series.name];
+			row.name = series.name;
+			row.kind = series.kind;
+			row.count += series.count;
+			row.max = std::max(row.max, series.max);
+			for (int bucket = 0; bucket < BucketCount; bucket++)
+				row.buckets[bucket] += series.buckets[bucket];
+		}
+	}
+
+	auto percentile = [](const Series& series, double fraction) {
+		uint64_t rank = (uint64_t)std::ceil(fraction * series.count);
+		uint64_t seen = 0;
+		for (int bucket = 0; bucket < BucketCount; bucket++)
+		{
+			seen += series.buckets[bucket];
+			if (seen >= rank && seen > 0)
+				return std::min(BucketValue(bucket), series.max);
+		}
+		return series.max;
+	};
+
+	const char* headings[] = { "Spans (ms)", "Samples (magnitude)", "Events" };
+	for (int kind = EventSpan; kind <= EventMark; kind++)
+	{
+		bool headed = false;
+		for (auto& entry : merged)
+		{
+			const Series& row = entry.second;
+			if (row.kind != kind)
+				continue;
+
+			if (!headed)
+			{
+				if (kind == EventMark)
+					printf("%-28s %10s\n", headings[kind], "count");
+				else
+					printf("%-28s %10s %10s %10s %10s\n", headings[kind], "count", "p50", "p99", "max");
+				headed = true;
+			}
+
+			if (kind == EventMark)
+				printf("  %-26s %10llu\n", row.name, (unsigned long long)row.count);
+			else
+				printf("  %-26s %10llu %10.3f %10.3f %10.3f\n", row.name, (unsigned long long)row.count,
+					   percentile(row, 0.5), percentile(row, 0.99), row.max);
+		}
+	}
+
+	if (overwritten > 0)
+	{
+		printf("Trace kept the last %llu of %llu events; the summary covers all of them\n",
+			   (unsigned long long)(recorded - overwritten), (unsigned long long)recorded);
+	}
+}
@@ -0,0 +1,256 @@
+#include "ThumbnailCache.h"
+
+#include <glad/glad.h>
+#include <iostream>
+#include <algorithm>
+
+ThumbnailCache::ThumbnailCache() {}
+
+ThumbnailCache::~ThumbnailCache()
+{
+	Close();
+}
+
+bool ThumbnailCache::Open(const char* filename, int count, int width)
+{
+	Close();
+
+	avFormatCTX = avformat_alloc_context();
+	if (!avFormatCTX)
+		return false;
+
+	mappedInput.Attach(avFormatCTX, filename);
+
+	if (avformat_open_input(&avFormatCTX, filename, nullptr, nullptr) != 0)
+	{
+		Close();
+		return false;
+	}
+
+	if (avformat_find_stream_info(avFormatCTX, nullptr) < 0)
+	{
+		Close();
+		return false;
+	}
+
+	const AVCodec* codec = nullptr;
+	videoStreamIndex = av_find_best_stream(avFormatCTX, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+	if (videoStreamIndex < 0 || !codec || avFormatCTX->duration <= 0)
+	{
+		Close();
+		return false;
+	}
+
+	for (unsigned int i = 0; i < avFormatCTX->nb_streams; i++)
+	{
+		if ((int)i != videoStreamIndex)
+			avFormatCTX->streams[i]->discard = AVDISCARD_ALL;
+	}
+
+	AVCodecParameters* params = avFormatCTX->streams[videoStreamIndex]->codecpar;
+	avCodecCTX = avcodec_alloc_context3(codec);
+	if (!avCodecCTX || avcodec_parameters_to_context(avCodecCTX, params) < 0)
+	{
+		Close();
+		return false;
+	}
+
+	// Keyframes only, single threaded and at reduced resolution where the decoder
+	// supports it: the tiles are tiny and this must not compete with playback
+	avCodecCTX->skip_frame = AVDISCARD_NONKEY;
+	avCodecCTX->thread_count = 1;
+
+	int lowres = 0;
+	while (lowres < codec->max_lowres && (params->width >> (lowres + 1)) >= width)
+		lowres++;
+	avCodecCTX->lowres = lowres;
+
+	if (avcodec_open2(avCodecCTX, codec, nullptr) < 0)
+	{
+		Close();
+		return false;
+	}
+
+	duration = avFormatCTX->duration / (double)AV_TIME_BASE;
+
+	tileCount = std::max(1, count);
+	tileWidth = width;
+	tileHeight = params->width > 0 ? std::max(1, width * params->height / params->width) : width * 9 / 16;
+	tileHeight += tileHeight & 1;
+	atlasColumns = std::min(tileCount, atlasColumns);
+
+	tilePixels.assign((size_t)tileCount * tileWidth * tileHeight * 4, 0);
+	tileReady.assign(tileCount, false);
+	pendingTiles.clear();
+
+	filling = true;
+	fillThread = std::thread(&ThumbnailCache::FillLoop, this);
+
+	return true;
+}
+
+void ThumbnailCache::FillLoop()
+{
+	AVPacket* packet = av_packet_alloc();
+	AVFrame* frame = av_frame_alloc();
+
+	for (int tile = 0; tile < tileCount && filling; tile++)
+	{
+		if (!DecodeTile(tile, packet, frame))
+			continue;
+
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		pendingTiles.push_back(tile);
+	}
+
+	av_frame_free(&frame);
+	av_packet_free(&packet);
+	filling = false;
+}
+
+bool ThumbnailCache::DecodeTile(int tile, AVPacket* packet, AVFrame* frame)
+{
+	AVStream* stream = avFormatCTX->streams[videoStreamIndex];
+
+	double seconds = (tile + 0.5) * duration / tileCount;
+	int64_t target = av_rescale_q((int64_t)(seconds * AV_TIME_BASE), AV_TIME_BASE_Q, stream->time_base);
+	if (stream->start_time != AV_NOPTS_VALUE)
+		target += stream->start_time;
+
+	if (av_seek_frame(avFormatCTX, videoStreamIndex, target, AVSEEK_FLAG_BACKWARD) < 0)
+		return false;
+
+	avcodec_flush_buffers(avCodecCTX);
+
+	bool decoded = false;
+	bool draining = false;
+
+	while (filling && !decoded)
+	{
+		if (!draining)
+		{
+			if (av_read_frame(avFormatCTX, packet) < 0)
+			{
+				draining = true;
+				avcodec_send_packet(avCodecCTX, nullptr);
+			}
+			else
+			{
+				if (packet->stream_index == videoStreamIndex)
+					avcodec_send_packet(avCodecCTX, packet);
+				av_packet_unref(packet);
+			}
+		}
+
+		int response = avcodec_receive_frame(avCodecCTX, frame);
+		if (response == 0)
+			decoded = true;
+		else if (response != AVERROR(EAGAIN))
+			break;
+	}
+
+	if (!decoded)
+		return false;
+
+	swsScalerCTX = sws_getCachedContext(swsScalerCTX, frame->width, frame->height, (AVPixelFormat)frame->format,
+										tileWidth, tileHeight, AV_PIX_FMT_RGBA, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+
+	if (!swsScalerCTX)
+	{
+		av_frame_unref(frame);
+		return false;
+	}
+
+	uint8_t* destination[4] = { &tilePixels[(size_t)tile * tileWidth * tileHeight * 4], nullptr, nullptr, nullptr };
+	int destinationLinesize[4] = { tileWidth * 4, 0, 0, 0 };
+	sws_scale(swsScalerCTX, frame->data, frame->linesize, 0, frame->height, destination, destinationLinesize);
+
+	av_frame_unref(frame);
+	return true;
+}
+
+void ThumbnailCache::UpdateAtlas()
+{
+	if (tileCount == 0)
+		return;
+
+	std::vector<int> tiles;
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		tiles.swap(pendingTiles);
+	}
+
+	if (tiles.empty())
+		return;
+
+	if (!atlasTexture)
+	{
+		int rows = (tileCount + atlasColumns - 1) / atlasColumns;
+
+		glGenTextures(1, &atlasTexture);
+		glBindTexture(GL_TEXTURE_2D, atlasTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasColumns * tileWidth, rows * tileHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, atlasTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	for (int tile : tiles)
+	{
+		int x = (tile % atlasColumns) * tileWidth;
+		int y = (tile / atlasColumns) * tileHeight;
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, tileWidth, tileHeight, GL_RGBA, GL_UNSIGNED_BYTE,
+						&tilePixels[(size_t)tile * tileWidth * tileHeight * 4]);
+		tileReady[tile] = true;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool ThumbnailCache::Lookup(float position, unsigned int* texture, glm::vec2* uvMin, glm::vec2* uvMax) const
+{
+	if (tileCount == 0 || !atlasTexture)
+		return false;
+
+	int tile = std::clamp((int)(position * tileCount), 0, tileCount - 1);
+	if (!tileReady[tile])
+		return false;
+
+	int rows = (tileCount + atlasColumns - 1) / atlasColumns;
+	glm::vec2 cell(1.0f / atlasColumns, 1.0f / rows);
+
+	*texture = atlasTexture;
+	*uvMin = glm::vec2(tile % atlasColumns, tile / atlasColumns) * cell;
+	*uvMax = *uvMin + cell;
+	return true;
+}
+
+void ThumbnailCache::Close()
+{
+	filling = false;
+	if (fillThread.joinable())
+		fillThread.join();
+
+	if (atlasTexture)
+	{
+		glDeleteTextures(1, &atlasTexture);
+		atlasTexture = 0;
+	}
+
+	sws_freeContext(swsScalerCTX);
+	swsScalerCTX = nullptr;
+	avcodec_free_context(&avCodecCTX);
+	avformat_close_input(&avFormatCTX);
+	mappedInput.Close();
+
+	videoStreamIndex = -1;
+	tileCount = 0;
+	tilePixels.clear();
+	tileReady.clear();
+	pendingTiles.clear();
+}
@@ -0,0 +1,194 @@
+#include "TimeStretcher.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Window and search range in seconds: long enough for a pitch period, short enough not to smear transients
+static const double WindowSeconds = 0.024;
+static const double SearchSeconds = 0.008;
+
+static void DotAndEnergy(const float* a, const float* b, size_t count, float* dot, float* energy)
+{
+	size_t i = 0;
+	float d = 0.0f;
+	float e = 0.0f;
+
+#if defined(__SSE2__)
+	__m128 dotSum = _mm_setzero_ps();
+	__m128 energySum = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 va = _mm_loadu_ps(a + i);
+		__m128 vb = _mm_loadu_ps(b + i);
+		dotSum = _mm_add_ps(dotSum, _mm_mul_ps(va, vb));
+		energySum = _mm_add_ps(energySum, _mm_mul_ps(va, va));
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, dotSum);
+	d = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	_mm_storeu_ps(lanes, energySum);
+	e = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+	for (; i < count; i++)
+	{
+		d += a[i] * b[i];
+		e += a[i] * a[i];
+	}
+
+	*dot = d;
+	*energy = e;
+}
+
+// output = overlap + source * window, with window given per frame and repeated across channels
+static void OverlapAdd(float* output, const float* overlap, const float* source, const float* window, size_t frames, int channels)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	if (channels == 2)
+	{
+		for (; i + 2 <= frames; i += 2)
+		{
+			__m128 w = _mm_set_ps(window[i + 1], window[i + 1], window[i], window[i]);
+			__m128 s = _mm_loadu_ps(source + i * 2);
+			__m128 o = _mm_loadu_ps(overlap + i * 2);
+			_mm_storeu_ps(output + i * 2, _mm_add_ps(o, _mm_mul_ps(s, w)));
+		}
+	}
+	else if (channels == 1)
+	{
+		for (; i + 4 <= frames; i += 4)
+		{
+			__m128 w = _mm_loadu_ps(window + i);
+			__m128 s = _mm_loadu_ps(source + i);
+			__m128 o = _mm_loadu_ps(overlap + i);
+			_mm_storeu_ps(output + i, _mm_add_ps(o, _mm_mul_ps(s, w)));
+		}
+	}
+#endif
+
+	for (; i < frames; i++)
+	{
+		for (int c = 0; c < channels; c++)
+			output[i * channels + c] = overlap[i * channels + c] + source[i * channels + c] * window[i];
+	}
+}
+
+TimeStretcher::TimeStretcher() {}
+
+void TimeStretcher::Init(int sampleRate, int channelCount)
+{
+	channels = std::max(1, channelCount);
+	hopFrames = std::max<size_t>(16, (size_t)(sampleRate * WindowSeconds / 2));
+	windowFrames = hopFrames * 2;
+	searchFrames = (size_t)(sampleRate * SearchSeconds);
+
+	// Periodic Hann: windows half a window apart sum to exactly one
+	window.resize(windowFrames);
+	for (size_t i = 0; i < windowFrames; i++)
+		window[i] = (float)(0.5 - 0.5 * std::cos(2.0 * M_PI * i / windowFrames));
+
+	Reset();
+}
+
+void TimeStretcher::Reset()
+{
+	input.clear();
+	overlap.assign(hopFrames * channels, 0.0f);
+	silence.assign(hopFrames * channels, 0.0f);
+	analysisPosition = 0.0;
+	continuation = -1;
+}
+
+size_t TimeStretcher::FindBestOffset(size_t nominal) const
+{
+	// Nothing to match yet, or the window already lands on the natural continuation
+	if (continuation < 0 || rate == 1.0)
+		return nominal;
+
+	const float* target = &input[continuation * channels];
+	size_t first = nominal > searchFrames ? nominal - searchFrames : 0;
+	size_t last = nominal + searchFrames;
+	size_t count = hopFrames * channels;
+
+	auto score = [&](size_t position) {
+		float dot, energy;
+		DotAndEnergy(&input[position * channels], target, count, &dot, &energy);
+		return dot / std::sqrt(energy + 1e-9f);
+	};
+
+	// Coarse pass every 4 frames, then refine around the winner
+	size_t best = nominal;
+	float bestScore = score(nominal);
+	for (size_t position = first; position <= last; position += 4)
+	{
+		float s = score(position);
+		if (s > bestScore)
+		{
+			bestScore = s;
+			best = position;
+		}
+	}
+
+	size_t coarse = best;
+	for (size_t position = coarse > first + 3 ? coarse - 3 : first; position <= std::min(last, coarse + 3); position++)
+	{
+		float s = score(position);
+		if (s > bestScore)
+		{
+			bestScore = s;
+			best = position;
+		}
+	}
+
+	return best;
+}
+
+void TimeStretcher::Process(const float* samples, size_t frameCount, std::vector<float>& output)
+{
+	input.insert(input.end(), samples, samples + frameCount * channels);
+	size_t inputFrames = input.size() / channels;
+
+	while (true)
+	{
+		size_t nominal = (size_t)std::lround(analysisPosition);
+		size_t searchEnd = rate == 1.0 ? nominal : nominal + searchFrames;
+
+		if (searchEnd + windowFrames > inputFrames)
+			break;
+		if (continuation >= 0 && (size_t)continuation + hopFrames > inputFrames)
+			break;
+
+		size_t position = FindBestOffset(nominal);
+		const float* frame = &input[position * channels];
+
+		size_t start = output.size();
+		output.resize(start + hopFrames * channels);
+		OverlapAdd(&output[start], overlap.data(), frame, window.data(), hopFrames, channels);
+
+		// The window's falling half waits for the next frame
+		OverlapAdd(overlap.data(), silence.data(), frame + hopFrames * channels, window.data() + hopFrames, hopFrames, channels);
+
+		continuation = (long)(position + hopFrames);
+		analysisPosition += hopFrames * rate;
+	}
+
+	// Drop input no future window or continuation can reach
+	size_t searchStart = (size_t)std::max(0.0, analysisPosition - searchFrames);
+	size_t keepFrom = continuation >= 0 ? std::min(searchStart, (size_t)continuation) : searchStart;
+	keepFrom = std::min(keepFrom, inputFrames);
+
+	if (keepFrom > 0)
+	{
+		input.erase(input.begin(), input.begin() + keepFrom * channels);
+		analysisPosition -= keepFrom;
+		if (continuation >= 0)
+			continuation -= (long)keepFrom;
+	}
+}
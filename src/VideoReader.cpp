@@ -1,4 +1,67 @@
 #include "VideoReader.h"
+#include "Telemetry.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <unistd.h>
+
+// Frames in a row that must be late to step the skip level up, or on time to step it down
+static const int LateFramesToEscalate = 12;
+static const int OnTimeFramesToRecover = 180;
+
+// Thread ids of this process
+static std::vector<pid_t> ListThreads()
+{
+  std::vector<pid_t> threads;
+  DIR* tasks = opendir("/proc/self/task");
+  if (!tasks)
+	return threads;
+
+  while (dirent* entry = readdir(tasks))
+  {
+	if (entry->d_name[0] != '.')
+	  threads.push_back((pid_t)atoi(entry->d_name));
+  }
+  closedir(tasks);
+
+  std::sort(threads.begin(), threads.end());
+  return threads;
+}
+
+// User plus system CPU time of one thread of this process; 0 once it has exited
+static double ThreadCpuSeconds(pid_t thread)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/self/task/%d/stat", (int)thread);
+  FILE* file = fopen(path, "r");
+  if (!file)
+	return 0.0;
+
+  char line[1024];
+  size_t length = fread(line, 1, sizeof(line) - 1, file);
+  fclose(file);
+  line[length] = '\0';
+
+  // The name in parentheses may hold spaces; utime and stime are the 12th and 13th fields after it
+  const char* fields = strrchr(line, ')');
+  unsigned long long utime = 0, stime = 0;
+  if (!fields || sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+	return 0.0;
+
+  static const long ticksPerSecond = sysconf(_SC_CLK_TCK);
+  return (double)(utime + stime) / ticksPerSecond;
+}
+
+static int64_t ThreadCpuNanoseconds()
+{
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
 
 VideoReader::VideoReader() {}
 
@@ -7,187 +70,605 @@ VideoReader::~VideoReader()
   Close();
 }
 
-bool VideoReader::Open(const char* filename)
+bool VideoReader::Open(MediaSource* source, const VideoDecodeOptions& options)
 {
-  // Suppress unnecessary FFmpeg warnings
-  av_log_set_level(AV_LOG_ERROR);
-  
-  avFormatCTX = avformat_alloc_context();
-  if (!avFormatCTX)
-	return false;
+  StopDecoding();
+  frameQueue.Flush();
+  endOfStream = false;
+  prerollSkipBefore = AV_NOPTS_VALUE;
+
+  mediaSource = source;
+  videoStreamIndex = source->GetVideoStreamIndex();
+  packetQueue = source->GetVideoQueue();
 
-  if (avformat_open_input(&avFormatCTX, filename, nullptr, nullptr) != 0)
+  if (videoStreamIndex == -1 || !packetQueue)
 	return false;
 
-  if (avformat_find_stream_info(avFormatCTX, nullptr) < 0)
+  AVFormatContext* avFormatCTX = source->GetFormatContext();
+  AVStream* avStream = avFormatCTX->streams[videoStreamIndex];
+  AVCodecParameters* avCodecParams = avStream->codecpar;
+  const AVCodec* avCodec = avcodec_find_decoder(avCodecParams->codec_id);
+
+  if (!avCodec)
 	return false;
 
-  videoStreamIndex = -1;
-  AVCodecParameters* avCodecParams = nullptr;
-  const AVCodec* avCodec = nullptr;
-  AVStream* avStream;
+  width  = avCodecParams->width;
+  height = avCodecParams->height;
+  timeBase = avStream->time_base;
+  totelFrames = avStream->nb_frames;
+
+  AVRational frameRate = av_guess_frame_rate(avFormatCTX, avStream, nullptr);
+  if (frameRate.num > 0 && frameRate.den > 0)
+	frameDuration = av_q2d(av_inv_q(frameRate));
 
-  for (int i = 0; i < avFormatCTX->nb_streams; i++)
+  if (avStream->duration != AV_NOPTS_VALUE)
+  {
+	duration = avStream->duration * av_q2d(avStream->time_base);
+  }
+  else if (avFormatCTX->duration != AV_NOPTS_VALUE)
   {
-	avCodecParams = avFormatCTX->streams[i]->codecpar;
-	avCodec = avcodec_find_decoder(avCodecParams->codec_id);
+	duration = avFormatCTX->duration / (double)AV_TIME_BASE;
+  }
+  else
+  {
+	duration = 0.0;
+  }
 
-	if (!avCodec)
-	  continue;
+  // Reopening for a stream in the same format keeps the decoder and its threads
+  if (avCodecCTX && openedParams && MediaSource::SameCodecParameters(openedParams, avCodecParams))
+  {
+	FlushDecoder();
+	avCodecCTX->pkt_timebase = avStream->time_base;
+	decodersReused++;
+  }
+  else
+  {
+	avcodec_free_context(&avCodecCTX);
+	if (avPacket)
+	  av_packet_unref(avPacket);
+	packetPending = false;
+	draining = false;
 
-	if (avCodecParams->codec_type == AVMEDIA_TYPE_VIDEO)
-	{
-	  videoStreamIndex = i;
-	  width  = avCodecParams->width;
-	  height = avCodecParams->height;
-	  timeBase = avFormatCTX->streams[i]->time_base;
-	  avStream = avFormatCTX->streams[videoStreamIndex];
-	  totelFrames = avFormatCTX->streams[videoStreamIndex]->nb_frames;
-
-	  if (avStream->duration != AV_NOPTS_VALUE)
-	  {
-		duration = avStream->duration * av_q2d(avStream->time_base);
-	  }
-	  else if (avFormatCTX->duration != AV_NOPTS_VALUE)
-	  {
-		duration = avFormatCTX->duration / (double)AV_TIME_BASE;
-	  }
-	  else
-	  {
-		duration = 0.0;
-	  }
+	avCodecCTX = avcodec_alloc_context3(avCodec);
+	if (!avCodecCTX)
+	  return false;
 
-	  break;
-	}
-  }
+	if (avcodec_parameters_to_context(avCodecCTX, avCodecParams) < 0)
+	  return false;
 
-  if (videoStreamIndex == -1)
-	return false;
+	avCodecCTX->pkt_timebase = avStream->time_base;
 
-  avCodecCTX = avcodec_alloc_context3(avCodec);
-  if (!avCodecCTX)
-	return false;
+	// Enable error concealment for H264
+	avCodecCTX->error_concealment = FF_EC_GUESS_MVS | FF_EC_DEBLOCK;
+	avCodecCTX->err_recognition = AV_EF_CAREFUL;
 
-  if (avcodec_parameters_to_context(avCodecCTX, avCodecParams) < 0)
-	return false;
+	ConfigureThreading(avCodecCTX, avCodec, options);
 
-  // Enable error concealment for H264
-  avCodecCTX->error_concealment = FF_EC_GUESS_MVS | FF_EC_DEBLOCK;
-  avCodecCTX->err_recognition = AV_EF_CAREFUL;
+	// Whatever threads appear while the decoder opens are its frame or slice threads
+	std::vector<pid_t> threadsBefore = ListThreads();
+	if (avcodec_open2(avCodecCTX, avCodec, nullptr) < 0)
+	  return false;
 
-  if (avcodec_open2(avCodecCTX, avCodec, nullptr) < 0)
-	return false;
+	std::vector<pid_t> threadsAfter = ListThreads();
+	codecThreadIds.clear();
+	std::set_difference(threadsAfter.begin(), threadsAfter.end(), threadsBefore.begin(), threadsBefore.end(),
+						std::back_inserter(codecThreadIds));
+
+	if (!openedParams)
+	  openedParams = avcodec_parameters_alloc();
+	if (!openedParams || avcodec_parameters_copy(openedParams, avCodecParams) < 0)
+	  return false;
+  }
 
-  avFrame  = av_frame_alloc();
-  avPacket = av_packet_alloc();
+  if (!avFrame)
+	avFrame = av_frame_alloc();
+  if (!avPacket)
+	avPacket = av_packet_alloc();
 
   if (!avFrame || !avPacket)
 	return false;
 
+  size_t previousFrameSize = frameSize;
+  outputFormat = options.outputFormat != AV_PIX_FMT_NONE ? options.outputFormat : ChooseOutputFormat(avCodecCTX->pix_fmt);
+  frameSize = av_image_get_buffer_size(outputFormat, width, height, 1);
+  frameQueue.Init(options.frameQueueDepth, frameSize);
+
+  if (convertPool && frameSize != previousFrameSize)
+	av_buffer_pool_uninit(&convertPool);
+
   return true;
 }
 
-bool VideoReader::ReadFrame(uint8_t* frameBuffer, int64_t* pts)
+void VideoReader::ConfigureThreading(AVCodecContext* codecCTX, const AVCodec* codec, const VideoDecodeOptions& options)
+{
+  int supported = 0;
+  if (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS)
+	supported |= FF_THREAD_FRAME;
+  if (codec->capabilities & (AV_CODEC_CAP_SLICE_THREADS | AV_CODEC_CAP_OTHER_THREADS))
+	supported |= FF_THREAD_SLICE;
+
+  int threadType = options.threadType ? (options.threadType & supported) : supported;
+  int threadCount = options.threadCount;
+
+  if (threadCount <= 0)
+  {
+	int cores = (int)std::thread::hardware_concurrency();
+	if (cores <= 0)
+	  cores = 4;
+
+	// Past a few threads per megapixel libavcodec only adds frame latency
+	long long pixels = (long long)codecCTX->width * codecCTX->height;
+	int cap = 4;
+	if (pixels > 1280 * 720)
+	  cap = 8;
+	if (pixels > 1920 * 1088)
+	  cap = 16;
+	if (pixels > 3840 * 2160)
+	  cap = 32;
+
+	switch (codecCTX->codec_id)
+	{
+	case AV_CODEC_ID_HEVC:
+	case AV_CODEC_ID_AV1:
+	case AV_CODEC_ID_VP9:
+	case AV_CODEC_ID_VVC:
+	  cap *= 2;
+	  break;
+
+	default:
+	  break;
+	}
+
+	threadCount = std::min(cores, std::min(cap, 64));
+  }
+
+  codecCTX->thread_count = threadType ? threadCount : 1;
+  codecCTX->thread_type = threadType;
+}
+
+AVPixelFormat VideoReader::ChooseOutputFormat(AVPixelFormat decoderFormat)
+{
+  // 8-bit layouts the renderer samples directly; anything else is converted to 4:2:0
+  switch (decoderFormat)
+  {
+  case AV_PIX_FMT_YUV420P:
+  case AV_PIX_FMT_YUVJ420P:
+  case AV_PIX_FMT_YUV422P:
+  case AV_PIX_FMT_YUVJ422P:
+  case AV_PIX_FMT_YUV444P:
+  case AV_PIX_FMT_YUVJ444P:
+  case AV_PIX_FMT_NV12:
+	return decoderFormat;
+
+  default:
+	return AV_PIX_FMT_YUV420P;
+  }
+}
+
+bool VideoReader::DecodeFrame()
 {
   int response;
 
   while (true)
   {
-	int ret = av_read_frame(avFormatCTX, avPacket);
-	if (ret < 0)
+	int level = prerollSkipBefore == AV_NOPTS_VALUE ? skipLevel.load() : SkipNone;
+
+	// Everything the decoder has ready comes out before more goes in
+	auto decodeStart = std::chrono::steady_clock::now();
+	int64_t spanStart = Telemetry::Begin();
+	response = avcodec_receive_frame(avCodecCTX, avFrame);
+	Telemetry::End("avcodec_receive_frame", spanStart);
+	decodeNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - decodeStart).count();
+
+	if (response >= 0)
 	{
+	  if (level >= SkipNonRef)
+		framesSkipping++;
+	  if (level >= SkipLoopFilter)
+		framesDegraded++;
+	  break;
+	}
+	else if (response == AVERROR_EOF)
 	  return false;
+	else if (response != AVERROR(EAGAIN))
+	{
+	  // Skip corrupted frames
+	  continue;
 	}
+	else if (draining)
+	  return false;
 
-	if (avPacket->stream_index != videoStreamIndex)
+	if (!packetPending)
 	{
-	  av_packet_unref(avPacket);
-	  continue;
+	  if (!packetQueue->Pop(avPacket))
+	  {
+		if (!packetQueue->IsEndOfStream())
+		  return false;
+
+		// Frame threads hold the last frames of the stream until told there is nothing more
+		avcodec_send_packet(avCodecCTX, nullptr);
+		draining = true;
+		continue;
+	  }
+
+	  // While prerolling a seek, frames nothing references and that end before the target are dropped undecoded
+	  bool skippable = prerollSkipBefore != AV_NOPTS_VALUE && avPacket->pts != AV_NOPTS_VALUE &&
+					   avPacket->pts < prerollSkipBefore;
+	  bool skipNonRef = skippable || level >= SkipNonRef || (prerollSkipBefore == AV_NOPTS_VALUE && skipNonRefForRate);
+	  avCodecCTX->skip_frame = skipNonRef ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+	  avCodecCTX->skip_loop_filter = level >= SkipLoopFilter ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
 	}
 
+	decodeStart = std::chrono::steady_clock::now();
+	spanStart = Telemetry::Begin();
 	response = avcodec_send_packet(avCodecCTX, avPacket);
+	Telemetry::End("avcodec_send_packet", spanStart);
+	decodeNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - decodeStart).count();
+
+	// Refused for now, not lost: it is sent again after the next receive
+	packetPending = response == AVERROR(EAGAIN);
+	if (packetPending)
+	  continue;
+
 	av_packet_unref(avPacket);
+	if (response >= 0 && level >= SkipNonRef)
+	  packetsSkipping++;
+	// Otherwise the packet was corrupt and is skipped
+  }
+
+  framesDecoded++;
+  return true;
+}
+
+void VideoReader::FlushDecoder()
+{
+  avcodec_flush_buffers(avCodecCTX);
+  av_packet_unref(avPacket);
+  packetPending = false;
+  draining = false;
+}
 
-	if (response < 0)
+bool VideoReader::ReadFrame(VideoFrame* frame)
+{
+  return DecodeFrame() && ConvertFrame(frame);
+}
+
+bool VideoReader::ConvertFrame(VideoFrame* frame)
+{
+  // Take over the decoder's reference; nothing is copied for formats we upload as is
+  av_frame_unref(frame->frame);
+  av_frame_move_ref(frame->frame, avFrame);
+  AVFrame* decoded = frame->frame;
+
+  frame->pts = (decoded->pts != AV_NOPTS_VALUE) ? decoded->pts : decoded->best_effort_timestamp;
+  frame->time = frame->pts * av_q2d(timeBase);
+  frame->format = outputFormat;
+  frame->colorspace = decoded->colorspace;
+  frame->colorRange = decoded->color_range;
+  frame->width = width;
+  frame->height = height;
+
+  bool native = decoded->format == outputFormat && decoded->width == width && decoded->height == height;
+
+  if (native && !frame->data)
+  {
+	for (int i = 0; i < 4; i++)
 	{
-	  // Skip corrupted packets
-	  continue;
+	  frame->planes[i] = decoded->data[i];
+	  frame->linesizes[i] = decoded->linesize[i];
 	}
+	return true;
+  }
 
-	response = avcodec_receive_frame(avCodecCTX, avFrame);
+  // Staging into the upload buffer, or converting into a pooled buffer
+  uint8_t* destination = frame->data;
+  if (!destination)
+  {
+	if (!convertPool)
+	  convertPool = av_buffer_pool_init(frameSize, nullptr);
 
-	if (response == AVERROR(EAGAIN))
-	  continue;
-	else if (response == AVERROR_EOF)
+	av_buffer_unref(&frame->converted);
+	frame->converted = av_buffer_pool_get(convertPool);
+	if (!frame->converted)
 	  return false;
-	else if (response < 0)
+
+	destination = frame->converted->data;
+  }
+
+  av_image_fill_arrays(frame->planes, frame->linesizes, destination, outputFormat, width, height, 1);
+
+  auto convertStart = std::chrono::steady_clock::now();
+  int64_t spanStart = Telemetry::Begin();
+
+  if (native)
+  {
+	av_image_copy(frame->planes, frame->linesizes, (const uint8_t* const*)decoded->data,
+				  decoded->linesize, outputFormat, width, height);
+
+	Telemetry::End("frame copy", spanStart);
+	copyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - convertStart).count();
+	framesCopied++;
+	return true;
+  }
+
+  swsScalerCTX = sws_getCachedContext(
+	  swsScalerCTX,
+	  decoded->width,
+	  decoded->height,
+	  (AVPixelFormat)decoded->format,
+	  width,
+	  height,
+	  outputFormat,
+	  SWS_BILINEAR,
+	  nullptr,
+	  nullptr,
+	  nullptr
+	  );
+
+  if (!swsScalerCTX)
+	return false;
+
+  sws_scale(swsScalerCTX, decoded->data, decoded->linesize, 0, decoded->height, frame->planes, frame->linesizes);
+
+  Telemetry::End("sws_scale", spanStart);
+  scaleNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+	  std::chrono::steady_clock::now() - convertStart).count();
+  framesScaled++;
+  return true;
+}
+
+void VideoReader::UseFrameStorage(uint8_t* storage, size_t slotCount)
+{
+  if (decoding)
+	return;
+
+  frameQueue.Init(slotCount, frameSize, storage);
+}
+
+void VideoReader::StartDecoding()
+{
+  if (decoding || !avCodecCTX)
+	return;
+
+  endOfStream = false;
+  decoding = true;
+  runStart = std::chrono::steady_clock::now();
+  runCodecCpuStart = CodecThreadsCpuSeconds();
+  decodeThread = std::thread(&VideoReader::DecodeLoop, this);
+}
+
+void VideoReader::StopDecoding()
+{
+  if (!decodeThread.joinable())
+	return;
+
+  decoding = false;
+  frameQueue.Abort(true);
+  packetQueue->Abort(true);
+
+  decodeThread.join();
+
+  runSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+  runCodecCpuSeconds += CodecThreadsCpuSeconds() - runCodecCpuStart;
+
+  frameQueue.Abort(false);
+  packetQueue->Abort(false);
+}
+
+void VideoReader::DecodeLoop()
+{
+  double lastQueuedTime = -1e9;
+
+  Telemetry::SetThreadName("video decoder");
+
+  int64_t cpuBase = workerCpuNanoseconds;
+  int64_t cpuStart = ThreadCpuNanoseconds();
+
+  while (decoding)
+  {
+	workerCpuNanoseconds = cpuBase + ThreadCpuNanoseconds() - cpuStart;
+
+	VideoFrame* frame = frameQueue.PeekWritable();
+	if (!frame)
+	  break;
+
+	if (!DecodeFrame())
 	{
-	  // Skip corrupted frames
+	  if (decoding)
+		endOfStream = true;
+	  break;
+	}
+
+	int64_t pts = (avFrame->pts != AV_NOPTS_VALUE) ? avFrame->pts : avFrame->best_effort_timestamp;
+	double time = pts * av_q2d(timeBase);
+
+	if (time > lastQueuedTime && time - lastQueuedTime < minFrameSpacing)
+	{
+	  av_frame_unref(avFrame);
+	  framesDecimated++;
 	  continue;
 	}
 
-	break;
+	if (!ConvertFrame(frame))
+	{
+	  if (decoding)
+		endOfStream = true;
+	  break;
+	}
+
+	lastQueuedTime = time;
+	frameQueue.Push();
   }
 
-  *pts = (avFrame->pts != AV_NOPTS_VALUE) ? avFrame->pts : avFrame->best_effort_timestamp;
+  workerCpuNanoseconds = cpuBase + ThreadCpuNanoseconds() - cpuStart;
+}
 
-  if (!swsScalerCTX)
+void VideoReader::SetPlaybackRate(double rate, double refreshInterval)
+{
+  // A little under one refresh, so content that exactly fills the display keeps every frame
+  double spacing = rate > 1.0 ? refreshInterval * rate * 0.9 : 0.0;
+  minFrameSpacing = spacing;
+  skipNonRefForRate = rate >= 2.0 && frameDuration * 2.0 <= spacing;
+}
+
+void VideoReader::DropFrame()
+{
+  frameQueue.Discard();
+  framesDroppedLate++;
+  Telemetry::Mark("frame dropped");
+  ReportLateness(frameDuration * 2.0);
+}
+
+void VideoReader::ReportLateness(double lateness)
+{
+  if (lateness > frameDuration)
   {
-	swsScalerCTX = sws_getContext(
-		width,
-		height,
-		avCodecCTX->pix_fmt,
-		width,
-		height,
-		AV_PIX_FMT_RGB0,
-		SWS_BILINEAR,
-		nullptr,
-		nullptr,
-		nullptr
-		);
+	onTimeStreak = 0;
+	if (++lateStreak >= LateFramesToEscalate && skipLevel < SkipNonRef)
+	{
+	  skipLevel++;
+	  skipEscalations++;
+	  lateStreak = 0;
+	}
   }
-  if (!swsScalerCTX)
-	return false;
+  else
+  {
+	lateStreak = 0;
+	if (++onTimeStreak >= OnTimeFramesToRecover && skipLevel > SkipNone)
+	{
+	  skipLevel--;
+	  onTimeStreak = 0;
+	}
+  }
+}
 
-  uint8_t* dest[4] = { frameBuffer, nullptr, nullptr, nullptr };
-  int destLinesizes[4] = { width * 4, 0, 0, 0 };
+VideoDecodeStats VideoReader::GetDecodeStats() const
+{
+  VideoDecodeStats stats;
+  stats.threadCount = avCodecCTX ? avCodecCTX->thread_count : 0;
+  stats.threadType = avCodecCTX ? avCodecCTX->active_thread_type : 0;
+  stats.framesDecoded = framesDecoded;
+  stats.decodeSeconds = decodeNanoseconds * 1e-9;
+  stats.scaleSeconds = scaleNanoseconds * 1e-9;
+  stats.copySeconds = copyNanoseconds * 1e-9;
+  stats.framesScaled = framesScaled;
+  stats.framesCopied = framesCopied;
+  stats.wallSeconds = runSeconds;
+  stats.codecThreads = (int)codecThreadIds.size();
+  stats.codecCpuSeconds = runCodecCpuSeconds;
+  stats.workerCpuSeconds = workerCpuNanoseconds * 1e-9;
+  stats.framesDroppedLate = framesDroppedLate;
+  stats.framesDegraded = framesDegraded;
+  stats.framesSkipped = packetsSkipping > framesSkipping ? packetsSkipping - framesSkipping : 0;
+  stats.framesDecimated = framesDecimated;
+  stats.decodersReused = decodersReused;
+  stats.skipLevel = skipLevel;
+  stats.skipEscalations = skipEscalations;
+
+  if (decoding)
+  {
+	stats.wallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+	stats.codecCpuSeconds += CodecThreadsCpuSeconds() - runCodecCpuStart;
+  }
 
-  sws_scale(swsScalerCTX, avFrame->data, avFrame->linesize, 0, height, dest, destLinesizes);
+  return stats;
+}
 
-  return true;
+double VideoReader::CodecThreadsCpuSeconds() const
+{
+  double seconds = 0.0;
+  for (pid_t thread : codecThreadIds)
+	seconds += ThreadCpuSeconds(thread);
+  return seconds;
 }
 
-bool VideoReader::Seek(double targetTime)
+bool VideoReader::IsFinished() const
 {
-  if (!avFormatCTX || videoStreamIndex < 0)
+  return endOfStream && frameQueue.Size() == 0;
+}
+
+bool VideoReader::Seek(double targetTime, FrameCache* cache)
+{
+  if (!avCodecCTX || videoStreamIndex < 0)
 	return false;
 
   targetTime = glm::clamp(targetTime, 0.0, duration - 0.033);
 
-  int64_t timestamp = (int64_t)(targetTime / av_q2d(timeBase));
+  FlushDecoder();
+  frameQueue.Flush();
+  endOfStream = false;
 
-  if (av_seek_frame(avFormatCTX, videoStreamIndex, timestamp, AVSEEK_FLAG_BACKWARD) < 0)
+  // Intermediate frames are only decoded; the one that reaches the target is converted into the first slot
+  VideoFrame* frame = frameQueue.PeekWritable();
+  if (!frame)
 	return false;
 
-  avcodec_flush_buffers(avCodecCTX);
+  AVStream* avStream = mediaSource->GetFormatContext()->streams[videoStreamIndex];
+  AVRational frameRate = av_guess_frame_rate(mediaSource->GetFormatContext(), avStream, nullptr);
+  int64_t targetPts = (int64_t)(targetTime / av_q2d(timeBase));
+  int64_t margin = frameRate.num > 0 ? av_rescale_q(1, av_inv_q(frameRate), timeBase)
+									 : (int64_t)(0.1 / av_q2d(timeBase));
 
-  int64_t pts;
-  uint8_t tempBuffer[width * height * 4];
-  
-  while (true)
+  // Filling a cache needs every frame, so nothing is skipped undecoded
+  prerollSkipBefore = cache ? AV_NOPTS_VALUE : targetPts - margin;
+  bool found = false;
+
+  VideoFrame scratch;
+  if (cache)
+	scratch.frame = av_frame_alloc();
+
+  while (DecodeFrame())
   {
-	if (!ReadFrame(tempBuffer, &pts))
-	  return false;
-	
-	double frameTime = pts * av_q2d(timeBase);
+	int64_t pts = (avFrame->pts != AV_NOPTS_VALUE) ? avFrame->pts : avFrame->best_effort_timestamp;
 	
-	if (frameTime >= targetTime - 0.001)
+	if (pts * av_q2d(timeBase) >= targetTime - 0.001)
+	{
+	  found = true;
 	  break;
+	}
+
+	if (cache && scratch.frame && ConvertFrame(&scratch))
+	  cache->Store(scratch);
+
+	av_frame_unref(avFrame);
   }
 
+  if (cache)
+  {
+	av_frame_free(&scratch.frame);
+	av_buffer_unref(&scratch.converted);
+  }
+
+  prerollSkipBefore = AV_NOPTS_VALUE;
+  avCodecCTX->skip_frame = AVDISCARD_DEFAULT;
+  lateStreak = 0;
+  onTimeStreak = 0;
+
+  if (!found || !ConvertFrame(frame))
+	return false;
+
+  if (cache)
+	cache->Store(*frame);
+
+  frameQueue.Push();
   return true;
 }
 
+long long VideoReader::GetTotalFrames() const
+{
+  if (mediaSource)
+  {
+	int64_t indexed = mediaSource->GetKeyframeIndex().GetFrameCount();
+	if (indexed >= 0)
+	  return indexed;
+  }
+
+  return totelFrames;
+}
+
 double VideoReader::GetDuration() const
 {
   return duration;
@@ -195,6 +676,15 @@ double VideoReader::GetDuration() const
 
 void VideoReader::Close()
 {
+  StopDecoding();
+  frameQueue.Flush();
+
+  if (convertPool)
+  {
+	av_buffer_pool_uninit(&convertPool);
+	convertPool = nullptr;
+  }
+
   if (swsScalerCTX)
   {
 	sws_freeContext(swsScalerCTX);
@@ -218,10 +708,11 @@ void VideoReader::Close()
 	avcodec_free_context(&avCodecCTX);
 	avCodecCTX = nullptr;
   }
+  codecThreadIds.clear();
 
-  if (avFormatCTX)
-  {
-	avformat_close_input(&avFormatCTX);
-	avFormatCTX = nullptr;
-  }
+  if (openedParams)
+	avcodec_parameters_free(&openedParams);
+
+  mediaSource = nullptr;
+  packetQueue = nullptr;
 }
@@ -1,4 +1,13 @@
 #include "VideoRenderer.h"
+#include "Telemetry.h"
+
+#include <chrono>
+
+extern "C"
+{
+#include <libavutil/common.h>
+#include <libavutil/pixdesc.h>
+}
 
 const char* videoVertexShader = R"(
 #version 330 core
@@ -22,11 +31,30 @@ out vec4 FragColor;
 
 in vec2 TexCoord;
 
-uniform sampler2D videoTexture;
+uniform sampler2D yTexture;
+uniform sampler2D uTexture;
+uniform sampler2D vTexture;
+uniform bool chromaInterleaved;
+
+uniform mat3 colorMatrix;
+uniform vec3 colorOffset;
 
 void main()
 {
-    FragColor = texture(videoTexture, TexCoord);
+    vec3 yuv;
+    yuv.x = texture(yTexture, TexCoord).r;
+
+    if (chromaInterleaved)
+    {
+        yuv.yz = texture(uTexture, TexCoord).rg;
+    }
+    else
+    {
+        yuv.y = texture(uTexture, TexCoord).r;
+        yuv.z = texture(vTexture, TexCoord).r;
+    }
+
+    FragColor = vec4(colorMatrix * (yuv - colorOffset), 1.0);
 }
 )";
 
@@ -69,22 +97,41 @@ VideoRenderer::VideoRenderer()
 
   shaderProgram = CreateShaderProgram();
 
-  glGenTextures(1, &videoTexture);
-  glBindTexture(GL_TEXTURE_2D, videoTexture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glGenTextures(3, planeTextures);
+  for (int i = 0; i < 3; i++)
+  {
+    glBindTexture(GL_TEXTURE_2D, planeTextures[i]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  }
   glBindTexture(GL_TEXTURE_2D, 0);
+
+  VideoFrame defaultFrame;
+  UpdateColorMatrix(defaultFrame);
 }
 
 VideoRenderer::~VideoRenderer()
 {
+  RetireUploads(true);
+
+  if (timerQueries[0])
+    glDeleteQueries(TimerQueryCount, timerQueries);
+
+  if (uploadBuffer)
+  {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &uploadBuffer);
+  }
+
   glDeleteVertexArrays(1, &VAO);
   glDeleteBuffers(1, &VBO);
   glDeleteBuffers(1, &EBO);
   glDeleteProgram(shaderProgram);
-  glDeleteTextures(1, &videoTexture);
+  glDeleteTextures(3, planeTextures);
 }
 
 GLuint VideoRenderer::CompileShader(const char* source, GLenum type)
@@ -128,15 +175,212 @@ GLuint VideoRenderer::CreateShaderProgram()
   return program;
 }
 
-void VideoRenderer::UpdateTexture(unsigned char* data, int width, int height)
+void VideoRenderer::UpdateColorMatrix(const VideoFrame& frame)
+{
+  // Luma weights of the frame's matrix; untagged streams follow the usual SD/HD split
+  float kr = 0.2126f, kb = 0.0722f;
+
+  switch (frame.colorspace)
+  {
+  case AVCOL_SPC_BT470BG:
+  case AVCOL_SPC_SMPTE170M:
+  case AVCOL_SPC_FCC:
+    kr = 0.299f; kb = 0.114f;
+    break;
+
+  case AVCOL_SPC_SMPTE240M:
+    kr = 0.212f; kb = 0.087f;
+    break;
+
+  case AVCOL_SPC_BT2020_NCL:
+  case AVCOL_SPC_BT2020_CL:
+    kr = 0.2627f; kb = 0.0593f;
+    break;
+
+  case AVCOL_SPC_BT709:
+    break;
+
+  default:
+    if (frame.height > 0 && frame.height < 720)
+    {
+      kr = 0.299f; kb = 0.114f;
+    }
+    break;
+  }
+
+  bool fullRange = frame.colorRange == AVCOL_RANGE_JPEG ||
+                   frame.format == AV_PIX_FMT_YUVJ420P ||
+                   frame.format == AV_PIX_FMT_YUVJ422P ||
+                   frame.format == AV_PIX_FMT_YUVJ444P;
+
+  float kg = 1.0f - kr - kb;
+  float yScale = fullRange ? 1.0f : 255.0f / 219.0f;
+  float cScale = fullRange ? 1.0f : 255.0f / 224.0f;
+
+  // Column-major: one column per Y, Cb, Cr input
+  float matrix[9] = {
+    yScale,                           yScale,                                     yScale,
+    0.0f,                             -2.0f * kb * (1.0f - kb) / kg * cScale,     2.0f * (1.0f - kb) * cScale,
+    2.0f * (1.0f - kr) * cScale,      -2.0f * kr * (1.0f - kr) / kg * cScale,     0.0f
+  };
+
+  for (int i = 0; i < 9; i++)
+    colorMatrix[i] = matrix[i];
+
+  colorOffset[0] = fullRange ? 0.0f : 16.0f / 255.0f;
+  colorOffset[1] = 128.0f / 255.0f;
+  colorOffset[2] = 128.0f / 255.0f;
+}
+
+uint8_t* VideoRenderer::CreateUploadBuffer(size_t frameSize, size_t slotCount)
+{
+  if (!GLAD_GL_VERSION_4_4 || uploadBuffer)
+    return uploadMapping;
+
+  GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  GLsizeiptr size = (GLsizeiptr)(frameSize * slotCount);
+
+  glGenBuffers(1, &uploadBuffer);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+  glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+  uploadMapping = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if (!uploadMapping)
+  {
+    std::cout << "Video upload buffer mapping failed, using client memory\n";
+    glDeleteBuffers(1, &uploadBuffer);
+    uploadBuffer = 0;
+  }
+
+  return uploadMapping;
+}
+
+size_t VideoRenderer::RetireUploads(bool wait)
 {
-  glBindTexture(GL_TEXTURE_2D, videoTexture);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+  size_t retired = completedClientUploads;
+  completedClientUploads = 0;
+
+  while (!uploadFences.empty())
+  {
+    GLenum result = glClientWaitSync(uploadFences.front(),
+                                     wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                     wait ? 1000000000 : 0);
+
+    if (result == GL_TIMEOUT_EXPIRED)
+      break;
+
+    glDeleteSync(uploadFences.front());
+    uploadFences.pop_front();
+    retired++;
+  }
+
+  return retired;
+}
+
+void VideoRenderer::AllocateTextures(const VideoFrame& frame, int chromaWidth, int chromaHeight)
+{
+  // Immutable storage has to be recreated rather than respecified
+  if (GLAD_GL_VERSION_4_2)
+  {
+    glDeleteTextures(3, planeTextures);
+    glGenTextures(3, planeTextures);
+  }
+
+  for (int i = 0; i < planeCount; i++)
+  {
+    int planeWidth  = i == 0 ? frame.width : chromaWidth;
+    int planeHeight = i == 0 ? frame.height : chromaHeight;
+    bool twoChannel = chromaInterleaved && i == 1;
+
+    glBindTexture(GL_TEXTURE_2D, planeTextures[i]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+    if (GLAD_GL_VERSION_4_2)
+      glTexStorage2D(GL_TEXTURE_2D, 1, twoChannel ? GL_RG8 : GL_R8, planeWidth, planeHeight);
+    else
+      glTexImage2D(GL_TEXTURE_2D, 0, twoChannel ? GL_RG8 : GL_R8, planeWidth, planeHeight, 0,
+                   twoChannel ? GL_RG : GL_RED, GL_UNSIGNED_BYTE, nullptr);
+  }
+
+  textureWidth = frame.width;
+  textureHeight = frame.height;
+  textureFormat = frame.format;
+}
+
+void VideoRenderer::UpdateTexture(const VideoFrame& frame, bool queued)
+{
+  TelemetryScope scope("UpdateTexture");
+  auto uploadStart = std::chrono::steady_clock::now();
+
+  const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(frame.format);
+  if (!desc)
+    return;
+
+  int chromaWidth  = AV_CEIL_RSHIFT(frame.width, desc->log2_chroma_w);
+  int chromaHeight = AV_CEIL_RSHIFT(frame.height, desc->log2_chroma_h);
+
+  chromaInterleaved = frame.format == AV_PIX_FMT_NV12;
+  planeCount = chromaInterleaved ? 2 : 3;
+
+  if (frame.width != textureWidth || frame.height != textureHeight || frame.format != textureFormat)
+    AllocateTextures(frame, chromaWidth, chromaHeight);
+
+  bool fromBuffer = uploadBuffer && frame.bufferOffset != SIZE_MAX;
+  if (fromBuffer)
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  for (int i = 0; i < planeCount; i++)
+  {
+    int planeWidth  = i == 0 ? frame.width : chromaWidth;
+    int planeHeight = i == 0 ? frame.height : chromaHeight;
+    bool twoChannel = chromaInterleaved && i == 1;
+
+    // With a bound unpack buffer the pointer argument is an offset into it
+    const void* pixels = frame.planes[i];
+    if (fromBuffer)
+      pixels = (const void*)(uintptr_t)(frame.bufferOffset + (frame.planes[i] - frame.data));
+
+    glBindTexture(GL_TEXTURE_2D, planeTextures[i]);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, frame.linesizes[i] / (twoChannel ? 2 : 1));
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planeWidth, planeHeight,
+                    twoChannel ? GL_RG : GL_RED, GL_UNSIGNED_BYTE, pixels);
+  }
+
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
   glBindTexture(GL_TEXTURE_2D, 0);
+
+  if (fromBuffer)
+  {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // Keep the number of frames the GPU may still be reading from bounded
+    if (uploadFences.size() >= MaxUploadsInFlight)
+      glClientWaitSync(uploadFences.front(), GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+
+    uploadFences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+  }
+  else if (queued)
+  {
+    completedClientUploads++;
+  }
+
+  UpdateColorMatrix(frame);
+
+  double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart).count();
+  uploadMilliseconds += (milliseconds - uploadMilliseconds) * 0.1;
 }
 
 void VideoRenderer::Render(int windowWidth, int windowHeight, int videoWidth, int videoHeight)
 {
+  TelemetryScope scope("Render");
+
   glUseProgram(shaderProgram);
 
   float videoAspect = (float)videoWidth / videoHeight;
@@ -163,11 +407,56 @@ void VideoRenderer::Render(int windowWidth, int windowHeight, int videoWidth, in
   GLuint projLoc = glGetUniformLocation(shaderProgram, "projection");
   glUniformMatrix4fv(projLoc, 1, GL_FALSE, projection);
 
+  const char* samplerNames[3] = { "yTexture", "uTexture", "vTexture" };
+  for (int i = 0; i < 3; i++)
+  {
+    glActiveTexture(GL_TEXTURE0 + i);
+    glBindTexture(GL_TEXTURE_2D, planeTextures[i]);
+    glUniform1i(glGetUniformLocation(shaderProgram, samplerNames[i]), i);
+  }
   glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, videoTexture);
-  glUniform1i(glGetUniformLocation(shaderProgram, "videoTexture"), 0);
+
+  glUniform1i(glGetUniformLocation(shaderProgram, "chromaInterleaved"), chromaInterleaved);
+  glUniformMatrix3fv(glGetUniformLocation(shaderProgram, "colorMatrix"), 1, GL_FALSE, colorMatrix);
+  glUniform3fv(glGetUniformLocation(shaderProgram, "colorOffset"), 1, colorOffset);
 
   glBindVertexArray(VAO);
   glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
   glBindVertexArray(0);
 }
+
+void VideoRenderer::BeginGpuTimer()
+{
+  if (!timerQueries[0])
+    glGenQueries(TimerQueryCount, timerQueries);
+
+  // Every query still waiting on the GPU: skip this frame rather than block
+  timerRunning = timersPending < TimerQueryCount;
+  if (timerRunning)
+    glBeginQuery(GL_TIME_ELAPSED, timerQueries[timerNext]);
+}
+
+void VideoRenderer::EndGpuTimer()
+{
+  if (timerRunning)
+  {
+    glEndQuery(GL_TIME_ELAPSED);
+    timerNext = (timerNext + 1) % TimerQueryCount;
+    timersPending++;
+    timerRunning = false;
+  }
+
+  while (timersPending > 0)
+  {
+    GLuint query = timerQueries[(timerNext - timersPending + TimerQueryCount) % TimerQueryCount];
+    GLint available = 0;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      break;
+
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+    gpuMilliseconds = nanoseconds * 1e-6;
+    timersPending--;
+  }
+}
@@ -2,17 +2,28 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "MediaSource.h"
 #include "VideoReader.h"
 #include "AudioReader.h"
+#include "AudioOutput.h"
+#include "Playlist.h"
+#include "ThumbnailCache.h"
+#include "FrameCache.h"
 #include "VideoRenderer.h"
+#include "Telemetry.h"
 #include "UI.h"
 #include "UIRenderer.h"
+#include "StatsOverlay.h"
+#include "IconAtlas.h"
 #include "glm/fwd.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -26,6 +37,7 @@ int HEIGHT = 1080;
 
 UIRenderer uiRenderer;
 UI ui;
+StatsOverlay statsOverlay;
 
 bool any_key_pressed = false;
 
@@ -41,18 +53,103 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 
 int main(int argc, char** argv)
 {
-  if (argc < 2)
+  Playlist playlist;
+  VideoDecodeOptions decodeOptions;
+  double playbackRate = 1.0;
+  size_t stepCacheMegabytes = 256;
+  ReadAheadOptions readAhead;
+  const char* tracePath = nullptr;
+  bool telemetry = false;
+  size_t traceEvents = Telemetry::DefaultEventsPerThread;
+  const char* fontPath = nullptr;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+
+    if (arg == "--frame-queue" && i + 1 < argc)
+    {
+      decodeOptions.frameQueueDepth = (size_t)std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--threads" && i + 1 < argc)
+    {
+      std::string value = argv[++i];
+      decodeOptions.threadCount = value == "auto" ? 0 : std::max(1, std::atoi(value.c_str()));
+    }
+    else if (arg == "--step-cache-mb" && i + 1 < argc)
+    {
+      stepCacheMegabytes = (size_t)std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--speed" && i + 1 < argc)
+    {
+      playbackRate = glm::clamp(std::atof(argv[++i]), 0.25, 4.0);
+    }
+    else if (arg == "--read-ahead" && i + 1 < argc)
+    {
+      std::string value = argv[++i];
+      readAhead.mode = value == "on" ? ReadAheadOn : value == "off" ? ReadAheadOff : ReadAheadAuto;
+    }
+    else if (arg == "--read-ahead-mb" && i + 1 < argc)
+    {
+      readAhead.windowBytes = (int64_t)std::max(1, std::atoi(argv[++i])) * 1024 * 1024;
+    }
+    else if (arg == "--read-ahead-seconds" && i + 1 < argc)
+    {
+      readAhead.windowSeconds = std::max(0.0, std::atof(argv[++i]));
+    }
+    else if (arg == "--trace" && i + 1 < argc)
+    {
+      tracePath = argv[++i];
+      telemetry = true;
+    }
+    else if (arg == "--trace-events" && i + 1 < argc)
+    {
+      traceEvents = (size_t)std::max(1024, std::atoi(argv[++i]));
+    }
+    else if (arg == "--telemetry")
+    {
+      telemetry = true;
+    }
+    else if (arg == "--stats")
+    {
+      statsOverlay.visible = true;
+    }
+    else if (arg == "--font" && i + 1 < argc)
+    {
+      fontPath = argv[++i];
+    }
+    else if (arg == "--thread-type" && i + 1 < argc)
+    {
+      std::string value = argv[++i];
+      if (value == "frame")
+        decodeOptions.threadType = FF_THREAD_FRAME;
+      else if (value == "slice")
+        decodeOptions.threadType = FF_THREAD_SLICE;
+      else
+        decodeOptions.threadType = 0;
+    }
+    else
+    {
+      playlist.Add(argv[i]);
+    }
+  }
+
+  if (playlist.Size() == 0)
   {
     std::cout << "No video file provided\n";
+    std::cout << "Usage: video-app [--frame-queue N] [--threads N|auto] [--thread-type frame|slice|auto] [--speed X] [--step-cache-mb N] [--read-ahead on|off|auto] [--read-ahead-mb N] [--read-ahead-seconds S] [--telemetry] [--trace FILE] [--trace-events N] [--stats] [--font FILE] <file|list.m3u>...\n";
     return -1;
   }
 
-  const char* videoPath = argv[1];
+  if (telemetry)
+    Telemetry::Enable(traceEvents);
+  Telemetry::SetThreadName("main");
 
   glfwInit();
 
   window = glfwCreateWindow(WIDTH, HEIGHT, TITLE, NULL, NULL);
   glfwMakeContextCurrent(window);
+  glfwSwapInterval(1);
   glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
   glfwSetKeyCallback(window, key_callback);
 
@@ -65,49 +162,77 @@ int main(int argc, char** argv)
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   
-  VideoReader video;
-  if (!video.Open(videoPath))
+  const GLFWvidmode* videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+  double refreshInterval = videoMode && videoMode->refreshRate > 0 ? 1.0 / videoMode->refreshRate : 1.0 / 60.0;
+  double presentLead = 0.5 * refreshInterval;
+
+  PlaybackSettings settings;
+  settings.decodeOptions = decodeOptions;
+  settings.playbackRate = playbackRate;
+  settings.refreshInterval = refreshInterval;
+  settings.readAhead = readAhead;
+
+  // Two items alternate: one plays while the next is opened and pre-decoded behind it
+  AudioOutput audioOutput;
+  PlaylistItem items[2];
+  PlaylistItem* current = &items[0];
+  PlaylistItem* next = &items[1];
+
+  size_t currentIndex = 0;
+  while (currentIndex < playlist.Size() && !current->Open(playlist.Get(currentIndex), &audioOutput, settings))
+    currentIndex++;
+
+  if (currentIndex == playlist.Size())
   {
     std::cout << "Couldn't open video\n";
     return -1;
   }
-  
-  AudioReader audio;
-  bool hasAudio = audio.Open(videoPath);
-  if (!hasAudio)
-  {
-    std::cout << "Warning: No audio stream found or couldn't open audio\n";
-  }
-  
-  glfwSetWindowTitle(window, videoPath);
+
+  long nextIndex = -1;
+  bool playlistExhausted = playlist.Size() == 1;
+
+  auto updateTitle = [&]() {
+    char title[512];
+    snprintf(title, sizeof(title), "%s (%gx)", current->path.c_str(), playbackRate);
+    glfwSetWindowTitle(window, playbackRate == 1.0 ? current->path.c_str() : title);
+  };
+  updateTitle();
 
   VideoRenderer videoRenderer;
 
-  int frameWidth = video.GetWidth();
-  int frameHeight = video.GetHeight();
-  unsigned char* frameData = new unsigned char[frameWidth * frameHeight * 4];
+  // Decode straight into the renderer's mapped upload buffer when the driver supports it;
+  // a prepared item only gets it while the playing one is not using it
+  size_t uploadSlots = decodeOptions.frameQueueDepth + VideoRenderer::MaxUploadsInFlight;
+  settings.storageFrameSize = current->video.GetFrameSize();
+  settings.storageSlots = uploadSlots;
+  uint8_t* uploadStorage = videoRenderer.CreateUploadBuffer(settings.storageFrameSize, uploadSlots);
+  settings.frameStorage = uploadStorage;
+
+  current->Start(settings);
+  current->PrintOpenTiming();
 
-  double videoDuration = video.GetDuration();
+  // About half a second of the next item's audio is decoded before it is needed
+  settings.audioPrefillSeconds = 0.5;
+
+  int frameWidth = current->video.GetWidth();
+  int frameHeight = current->video.GetHeight();
+
+  double videoDuration = current->video.GetDuration();
   double currentVideoTime = 0.0;
-  
-  int64_t pts;
-  if (video.ReadFrame(frameData, &pts))
-  {
-    videoRenderer.UpdateTexture(frameData, frameWidth, frameHeight);
-    currentVideoTime = pts * (double)video.GetTimeBase().num / (double)video.GetTimeBase().den;
-  }
-  
-  if (hasAudio)
-  {
-    if (!audio.PrefillBuffer())
-    {
-      std::cout << "Warning: Failed to prefill audio buffer\n";
-    }
-  }
-  
+
+  // Frames around the paused position, so stepping back does not re-decode the GOP each time
+  FrameCache stepCache;
+  stepCache.Init(stepCacheMegabytes * 1024 * 1024);
+  bool stepped = false;
+
+  // Media time runs playbackRate times faster than the wall clock
   double startTime = glfwGetTime();
+  auto mediaClock = [&]() { return (glfwGetTime() - startTime) * playbackRate; };
+  auto setMediaClock = [&](double time) { startTime = glfwGetTime() - time / playbackRate; };
 
   uiRenderer.init();
+  if (!uiRenderer.initText(fontPath, 16))
+    std::cout << "No usable font found, the statistics overlay is unavailable\n";
   glm::mat4 projection = glm::ortho(0.0f, (float)WIDTH, 0.0f, (float)HEIGHT, -1.0f, 1.0f);
   uiRenderer.setProjection(projection);
 
@@ -133,14 +258,21 @@ int main(int argc, char** argv)
   float targetSlideOffset = 0.0f;
 
   bool wasSpacePressed = false;
+  bool wasSpeedKeyPressed = false;
+  bool wasStepKeyPressed = false;
+  bool wasStatsKeyPressed = false;
+  const double speedSteps[] = { 0.5, 0.75, 1.0, 1.25, 1.5, 2.0, 2.5, 3.0 };
   
-  unsigned int playIcon = uiRenderer.loadTexture("assets/play.png");
-  unsigned int pauseIcon = uiRenderer.loadTexture("assets/pause.png");
-  unsigned int audioIcon = uiRenderer.loadTexture("assets/volume.png");
-  unsigned int muteIcon = uiRenderer.loadTexture("assets/volume-mute.png");
-  unsigned int fullscreenIcon = uiRenderer.loadTexture("assets/fullscreen.png");
-  unsigned int unfullscreenIcon = uiRenderer.loadTexture("assets/exit-fullscreen.png");
-  unsigned int loopIcon = uiRenderer.loadTexture("assets/repeat.png");
+  // One texture for every icon, so the control bar draws without rebinding
+  IconAtlas icons;
+  int playIcon = icons.add("assets/play.png");
+  int pauseIcon = icons.add("assets/pause.png");
+  int audioIcon = icons.add("assets/volume.png");
+  int muteIcon = icons.add("assets/volume-mute.png");
+  int fullscreenIcon = icons.add("assets/fullscreen.png");
+  int unfullscreenIcon = icons.add("assets/exit-fullscreen.png");
+  int loopIcon = icons.add("assets/repeat.png");
+  icons.build();
 
   bool sliderJustReleased = false;
   bool volumeSliderJustReleased = false;
@@ -148,30 +280,118 @@ int main(int argc, char** argv)
   double seekTargetTime = 0.0;
   float seekTargetVolume = 1.0f;
   
-  std::thread audioThread;
-  bool audioThreadRunning = true;
-  
-  if (hasAudio)
-  {
-    audioThread = std::thread([&]() {
-      while (audioThreadRunning)
+  auto seekTo = [&](double targetTime) {
+    current->video.StopDecoding();
+    if (current->hasAudio)
+      current->audio.StopDecoding();
+
+    // Seek rewrites queue slots, so the GPU must be done reading them
+    videoRenderer.RetireUploads(true);
+
+    // A rate change takes effect here, with nothing decoded at the old rate left buffered
+    current->video.SetPlaybackRate(playbackRate, refreshInterval);
+    if (current->hasAudio)
+      current->audio.SetPlaybackRate(playbackRate);
+
+    if (current->source.Seek(targetTime) && current->video.Seek(targetTime))
+    {
+      if (VideoFrame* frame = current->video.PeekFrame())
       {
-        if (play && !seeking && hasAudio)
-        {
-          audio.FillBuffer();
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        currentVideoTime = frame->time;
+        videoRenderer.UpdateTexture(*frame);
+        current->video.PopFrame();
       }
-    });
-    
-    audio.Play();
-  }
+      setMediaClock(currentVideoTime);
+    }
+
+    if (current->hasAudio)
+    {
+      current->audio.Seek(targetTime);
+      current->audio.PrefillBuffer();
+      current->audio.StartDecoding();
+    }
+
+    current->video.StartDecoding();
+    stepped = false;
+  };
+
+  double driftSum = 0.0;
+  double driftMax = 0.0;
+  uint64_t driftSamples = 0;
+
+  // Media time of a frame uploaded this iteration, timed against the previous one after the swap
+  double presentedTime = -1.0;
+  double lastPresentWall = -1.0;
+  double lastPresentTime = 0.0;
+
+  // Overlay rates are taken over half-second windows
+  PlaybackStats playbackStats;
+  double statsWindowStart = glfwGetTime();
+  uint64_t statsDecodedAtStart = 0;
+  uint64_t framesPresented = 0;
+  uint64_t statsPresentedAtStart = 0;
+  double windowDriftMax = 0.0;
+  int itemSwitches = 0;
+
+  // The prepared item takes over: its first frame is already decoded and, when both
+  // items have audio, the device has already moved on to it by itself
+  auto switchToNext = [&]() {
+    videoRenderer.RetireUploads(true);
+
+    std::swap(current, next);
+    currentIndex = (size_t)nextIndex;
+    nextIndex = -1;
+
+    next->Stop();
+    next->thumbnails.Close();
+    playlistExhausted = false;
+    stepCache.Clear();
+    stepped = false;
+    itemSwitches++;
+
+    frameWidth = current->video.GetWidth();
+    frameHeight = current->video.GetHeight();
+    videoDuration = current->video.GetDuration();
+    updateTitle();
+    current->PrintOpenTiming();
+
+    currentVideoTime = 0.0;
+    if (VideoFrame* frame = current->video.PeekFrame())
+    {
+      currentVideoTime = frame->time;
+      videoRenderer.UpdateTexture(*frame);
+      current->video.PopFrame();
+    }
+
+    // Prepared before a speed change, so it is brought to the current rate the same way
+    if (current->GetPlaybackRate() != playbackRate)
+      seekTo(currentVideoTime);
+
+    if (current->hasAudio && current->audio.IsPlaying() && !current->audio.IsFinished())
+      setMediaClock(current->audio.GetClock());
+    else
+      setMediaClock(currentVideoTime);
+
+    if (current->hasAudio)
+      current->audio.Play();
+    else
+      audioOutput.Stop();
+  };
+
+  if (current->hasAudio)
+    current->audio.Play();
 
   while (!glfwWindowShouldClose(window))
   {
+    int64_t frameSpan = Telemetry::Begin();
+
     glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
+    bool timingGpu = statsOverlay.visible;
+    if (timingGpu)
+      videoRenderer.BeginGpuTimer();
+
     int window_width, window_height;
     glfwGetFramebufferSize(window, &window_width, &window_height);
 
@@ -211,75 +431,210 @@ int main(int argc, char** argv)
     
     uiSlideOffset = smoothAnimation(uiSlideOffset, targetSlideOffset, 0.15f);
 
-    if (play && !seeking)
+    for (size_t retired = videoRenderer.RetireUploads(); retired > 0; retired--)
+      current->video.ReleaseFrame();
+
+    // Open the following item in the background while this one plays, skipping files that fail
+    if (!playlistExhausted && !next->IsPreparing() && !next->IsReady())
     {
-      int64_t pts;
-      if (video.ReadFrame(frameData, &pts))
+      size_t candidate = (nextIndex < 0 ? currentIndex : (size_t)nextIndex) + 1;
+      if (candidate >= playlist.Size() && loopEnabled)
+        candidate = 0;
+
+      if (candidate >= playlist.Size() || candidate == currentIndex)
       {
-        double presentationTimestamp = pts * (double)video.GetTimeBase().num / (double)video.GetTimeBase().den;
-        currentVideoTime = presentationTimestamp;
-        
-        if (hasAudio && audio.IsPlaying())
+        playlistExhausted = true;
+        nextIndex = -1;
+      }
+      else
+      {
+        nextIndex = (long)candidate;
+        settings.frameStorage = current->UsesFrameStorage() ? nullptr : uploadStorage;
+        next->Prepare(playlist.Get(candidate), &audioOutput, settings);
+      }
+    }
+
+    // Wrapping around to the start is only allowed while looping
+    bool nextPlayable = next->IsReady() && (loopEnabled || nextIndex > (long)currentIndex);
+
+    // Hand the device over to the next item's audio as soon as the current one drains
+    if (nextPlayable && current->hasAudio && next->hasAudio && next->GetPlaybackRate() == playbackRate &&
+        audioOutput.GetSource() == &current->audio)
+    {
+      if (audioOutput.GetQueued() != &next->audio)
+        audioOutput.QueueNext(&next->audio);
+    }
+    else if (audioOutput.GetQueued() == &next->audio)
+    {
+      audioOutput.QueueNext(nullptr);
+    }
+
+    // [ and ] step the playback rate; it is applied through a seek so nothing plays out at the old rate
+    bool slowerPressed = glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS;
+    bool fasterPressed = glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS;
+    if ((slowerPressed || fasterPressed) && !wasSpeedKeyPressed && !seeking)
+    {
+      size_t stepCount = sizeof(speedSteps) / sizeof(speedSteps[0]);
+      size_t step = 0;
+      while (step + 1 < stepCount && speedSteps[step] < playbackRate)
+        step++;
+
+      if (fasterPressed && speedSteps[step] <= playbackRate && step + 1 < stepCount)
+        step++;
+      if (slowerPressed && step > 0)
+        step--;
+
+      if (speedSteps[step] != playbackRate && (fasterPressed == (speedSteps[step] > playbackRate)))
+      {
+        playbackRate = speedSteps[step];
+        settings.playbackRate = playbackRate;
+        seekTo(currentVideoTime);
+
+        if (current->hasAudio && play)
+          current->audio.Play();
+
+        updateTitle();
+      }
+    }
+    wasSpeedKeyPressed = slowerPressed || fasterPressed;
+
+    // , and . step one frame back or forward, pausing first if needed
+    bool backPressed = glfwGetKey(window, GLFW_KEY_COMMA) == GLFW_PRESS;
+    bool forwardPressed = glfwGetKey(window, GLFW_KEY_PERIOD) == GLFW_PRESS;
+    if ((backPressed || forwardPressed) && !wasStepKeyPressed && !seeking)
+    {
+      if (play)
+      {
+        play = false;
+        if (current->hasAudio)
+          current->audio.Pause();
+      }
+
+      double maxGap = current->video.GetFrameDuration() * 1.5;
+      VideoFrame cached;
+
+      if (forwardPressed)
+      {
+        if (stepCache.FindAdjacent(currentVideoTime, 1, maxGap, &cached))
         {
-          double audioTime = audio.GetCurrentTime();
-          double audioLatency = audio.GetAudioLatency();
-          double effectiveAudioTime = audioTime - audioLatency;
-          double audioDrift = currentVideoTime - effectiveAudioTime;
-          
-          if (std::abs(audioDrift) > 0.040)
+          videoRenderer.UpdateTexture(cached, false);
+          currentVideoTime = cached.time;
+        }
+        else
+        {
+          // After stepping back the queue still holds frames up to the one we came from
+          VideoFrame* frame = current->video.PeekFrame();
+          while (frame && frame->time <= currentVideoTime + 1e-6)
           {
-            if (audioDrift > 0)
-            {
-              std::this_thread::sleep_for(std::chrono::milliseconds(5));
-            }
+            current->video.DiscardFrame();
+            frame = current->video.PeekFrame();
+          }
+
+          if (frame)
+          {
+            stepCache.Store(*frame);
+            currentVideoTime = frame->time;
+            videoRenderer.UpdateTexture(*frame);
+            current->video.PopFrame();
           }
         }
+      }
+      else
+      {
+        bool found = stepCache.FindAdjacent(currentVideoTime, -1, maxGap, &cached);
 
-        while (true)
+        if (!found && currentVideoTime > 0.0)
         {
-          double currentTime = glfwGetTime();
-          double delay = (startTime + presentationTimestamp) - currentTime;
+          // Decode from the keyframe before the previous frame up to this one, caching all of it;
+          // this frame goes back on the queue so stepping forward carries on from here
+          double fromTime = currentVideoTime;
+          current->video.StopDecoding();
+          if (current->hasAudio)
+            current->audio.StopDecoding();
+          videoRenderer.RetireUploads(true);
 
-          if (delay <= 0.0)
-            break;
+          if (current->source.Seek(std::max(0.0, fromTime - maxGap)))
+            current->video.Seek(fromTime, &stepCache);
 
-          if (delay > 0.002)
-            std::this_thread::sleep_for(std::chrono::microseconds((int)(delay * 1e6)));
-          else
-            std::this_thread::yield();
+          current->video.StartDecoding();
+          found = stepCache.FindAdjacent(fromTime, -1, maxGap, &cached);
         }
 
-        videoRenderer.UpdateTexture(frameData, frameWidth, frameHeight);
+        if (found)
+        {
+          videoRenderer.UpdateTexture(cached, false);
+          currentVideoTime = cached.time;
+        }
       }
-      else
+
+      stepped = true;
+    }
+    wasStepKeyPressed = backPressed || forwardPressed;
+
+    if (play && !seeking)
+    {
+      // Video slaves to the audio device clock; the wall clock takes over without audio or after it ends
+      if (current->hasAudio && current->audio.IsPlaying() && !current->audio.IsFinished())
+        setMediaClock(current->audio.GetClock());
+
+      // A frame is due if it starts before the middle of the refresh it would be shown in
+      double clock = mediaClock();
+      double due = clock + presentLead * playbackRate;
+      VideoFrame* frame = current->video.PeekFrame();
+
+      // A frame whose successor is already due would only be shown late, so skip it unshown
+      while (frame && current->video.PeekFrame(1) && current->video.PeekFrame(1)->time <= due)
       {
-        if (loopEnabled)
+        current->video.DropFrame();
+        frame = current->video.PeekFrame();
+      }
+
+      // Otherwise the previous frame simply stays up until this one is due
+      if (frame)
+      {
+        if (frame->time <= due)
+        {
+          currentVideoTime = frame->time;
+          videoRenderer.UpdateTexture(*frame);
+          current->video.PopFrame();
+          current->video.ReportLateness((clock - currentVideoTime) / playbackRate);
+
+          double drift = std::abs(currentVideoTime - clock) / playbackRate;
+          Telemetry::Value("A/V drift ms", 1000.0 * (currentVideoTime - clock) / playbackRate);
+          presentedTime = currentVideoTime;
+          framesPresented++;
+          playbackStats.driftMs = 1000.0 * (currentVideoTime - clock) / playbackRate;
+          windowDriftMax = std::max(windowDriftMax, 1000.0 * drift);
+          driftSum += drift;
+          driftMax = std::max(driftMax, drift);
+          driftSamples++;
+        }
+      }
+      else if (current->video.IsFinished())
+      {
+        // Audio decides when an item with sound is over, the last frame's duration otherwise
+        bool itemOver = current->hasAudio ?
+          audioOutput.GetSource() != &current->audio || current->audio.IsFinished() :
+          clock >= currentVideoTime + current->video.GetFrameDuration();
+
+        if (nextPlayable || (nextIndex >= 0 && next->IsPreparing()))
+        {
+          if (itemOver && nextPlayable)
+            switchToNext();
+        }
+        else if (loopEnabled)
         {
           seekTargetTime = 0.0;
-          if (video.Seek(0.0))
-          {
-            int64_t pts;
-            if (video.ReadFrame(frameData, &pts))
-            {
-              double actualTime = pts * (double)video.GetTimeBase().num / (double)video.GetTimeBase().den;
-              currentVideoTime = actualTime;
-              videoRenderer.UpdateTexture(frameData, frameWidth, frameHeight);
-              startTime = glfwGetTime() - actualTime;
-            }
-          }
+          seekTo(0.0);
           
-          if (hasAudio)
-          {
-            audio.Seek(0.0);
-            audio.PrefillBuffer();
-            audio.Play();
-          }
+          if (current->hasAudio)
+            current->audio.Play();
         }
         else
         {
           play = false;
-          if (hasAudio)
-            audio.Pause();
+          if (current->hasAudio)
+            current->audio.Pause();
         }
       }
     }
@@ -292,6 +647,8 @@ int main(int argc, char** argv)
 
     if (uiSlideOffset > -150.0f)
     {
+      TelemetryScope uiScope("UI");
+
       float containerWidth = 800.0f;
       float containerHeight = 100.0f;
       float containerX = window_width / 2.0f;
@@ -299,6 +656,8 @@ int main(int argc, char** argv)
       
       AABB mainContainer(glm::vec2(containerX, containerY), 
                          glm::vec2(containerWidth, containerHeight), 12.0f);
+      uiRenderer.renderShadow(AABB(mainContainer.position - glm::vec2(0.0f, 4.0f), mainContainer.size, 12.0f),
+                              12.0f, glm::vec4(0.0f, 0.0f, 0.0f, 0.5f));
       uiRenderer.renderFilledAABB(mainContainer, glm::vec4(0.0f, 0.0f, 0.0f, 0.85f));
 
       if (!seeking)
@@ -342,8 +701,8 @@ int main(int argc, char** argv)
         if (!seeking)
         {
           seeking = true;
-          if (hasAudio)
-            audio.Pause();
+          if (current->hasAudio)
+            current->audio.Pause();
         }
         seekTargetTime = sliderValue * videoDuration;
         sliderJustReleased = false;
@@ -354,38 +713,46 @@ int main(int argc, char** argv)
         
         seekTargetTime = glm::clamp(seekTargetTime, 0.0, videoDuration - 0.033);
         
-        if (video.Seek(seekTargetTime))
-        {
-          int64_t pts;
-          if (video.ReadFrame(frameData, &pts))
-          {
-            double actualTime = pts * (double)video.GetTimeBase().num / (double)video.GetTimeBase().den;
-            currentVideoTime = actualTime;
-            videoRenderer.UpdateTexture(frameData, frameWidth, frameHeight);
-            
-            startTime = glfwGetTime() - actualTime;
-          }
-        }
+        seekTo(seekTargetTime);
         
-        if (hasAudio)
-        {
-          audio.Seek(seekTargetTime);
-          audio.PrefillBuffer();
-          if (play)
-            audio.Play();
-        }
+        if (current->hasAudio && play)
+          current->audio.Play();
         
         seeking = false;
       }
 
       ui.end();
 
+      // Hover preview: the tile under the cursor, or under the thumb while dragging
+      current->thumbnails.UpdateAtlas();
+
+      AABB timelineTrack(glm::vec2(containerX, timelineY), glm::vec2(timelineWidth, 20.0f));
+      if (seeking || timelineTrack.contains(ui.mousePos))
+      {
+        float hoverPosition = seeking ? sliderValue : (ui.mousePos.x - timelineTrack.getMin().x) / timelineWidth;
+        hoverPosition = glm::clamp(hoverPosition, 0.0f, 1.0f);
+
+        unsigned int atlas;
+        glm::vec2 uvMin, uvMax;
+        if (current->thumbnails.Lookup(hoverPosition, &atlas, &uvMin, &uvMax))
+        {
+          glm::vec2 tileSize = current->thumbnails.GetTileSize();
+          float previewX = timelineTrack.getMin().x + hoverPosition * timelineWidth;
+          previewX = glm::clamp(previewX, tileSize.x / 2.0f + 4.0f, window_width - tileSize.x / 2.0f - 4.0f);
+          float previewY = containerY + containerHeight / 2.0f + tileSize.y / 2.0f + 12.0f;
+
+          uiRenderer.renderFilledAABB(AABB(glm::vec2(previewX, previewY), tileSize + 8.0f, 6.0f), glm::vec4(0.0f, 0.0f, 0.0f, 0.85f));
+          uiRenderer.renderTexturedAABB(AABB(glm::vec2(previewX, previewY), tileSize), atlas,
+                                        glm::vec4(1.0f), glm::vec4(1.0f), uvMin, uvMax);
+        }
+      }
+
       float buttonY = containerY - 20.0f;
       
       ui.begin(glm::vec2(containerX, buttonY));
       {
-        unsigned int pauseButtonTexture = play ? pauseIcon : playIcon;
-        auto pauseButton = ui.textureButton(&uiRenderer, pauseButtonTexture, glm::vec2(60, 60), 0);
+        const Icon& pauseButtonIcon = icons.get(play ? pauseIcon : playIcon);
+        auto pauseButton = ui.textureButton(&uiRenderer, pauseButtonIcon, glm::vec2(60, 60), 0);
 
         bool isSpacePressed = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
         if (pauseButton || (isSpacePressed && !wasSpacePressed))
@@ -393,14 +760,20 @@ int main(int argc, char** argv)
           play = !play;
           if (play)
           {
-            startTime = glfwGetTime() - currentVideoTime;
-            if (hasAudio)
-              audio.Play();
+            // Audio stayed where stepping started; bring everything back to the shown frame
+            if (stepped)
+            {
+              seekTo(currentVideoTime);
+              stepped = false;
+            }
+            setMediaClock(currentVideoTime);
+            if (current->hasAudio)
+              current->audio.Play();
           }
           else
           {
-            if (hasAudio)
-              audio.Pause();
+            if (current->hasAudio)
+              current->audio.Pause();
           }
         }
         wasSpacePressed = isSpacePressed;
@@ -409,18 +782,18 @@ int main(int argc, char** argv)
 
       ui.begin(glm::vec2(mainContainer.getTopLeft().x + 60, buttonY));
       {
-        unsigned int audioButtonIcon = mute ? muteIcon : audioIcon;
+        const Icon& audioButtonIcon = icons.get(mute ? muteIcon : audioIcon);
         auto audioButton = ui.textureButton(&uiRenderer, audioButtonIcon, glm::vec2(32, 32), 2);
 
         if (audioButton)
         {
           mute = !mute;
           if (mute) {
-            ma_device_set_master_volume(&audio.GetDevice(), 0);
+            audioOutput.SetVolume(0);
           } else {
             if (volumeValue == 0.0f)
               volumeValue = 0.5f;
-           ma_device_set_master_volume(&audio.GetDevice(), volumeValue);
+           audioOutput.SetVolume(volumeValue);
           }
         }
       }
@@ -459,7 +832,7 @@ int main(int argc, char** argv)
           seekTargetVolume = glm::clamp(seekTargetVolume, 0.0f, 1.0f);
           volumeValue = seekTargetVolume;
           
-          ma_device_set_master_volume(&audio.GetDevice(), volumeValue);
+          audioOutput.SetVolume(volumeValue);
           
           if (volumeValue == 0.0f) 
             mute = true;
@@ -474,18 +847,22 @@ int main(int argc, char** argv)
       ui.begin(glm::vec2(mainContainer.getTopRight().x - 110, buttonY));
       {
         vec4 loopColor = loopEnabled ? vec4(0.3f, 0.8f, 1.0f, 1.0f) : vec4(1.0f, 1.0f, 1.0f, 1.0f);
-        auto loopButton = ui.textureButton(&uiRenderer, loopIcon, glm::vec2(32, 32), 5, loopColor);
+        auto loopButton = ui.textureButton(&uiRenderer, icons.get(loopIcon), glm::vec2(32, 32), 5, loopColor);
         
         if (loopButton)
         {
           loopEnabled = !loopEnabled;
+
+          // Looping a playlist wraps to its start, so the end may have a next item again
+          if (loopEnabled)
+            playlistExhausted = playlist.Size() == 1;
         }
       }
       ui.end();
 
       ui.begin(glm::vec2(mainContainer.getTopRight().x - 60, buttonY));
       {
-        unsigned int fullscreenButtonIcon = isFullscreen ? unfullscreenIcon : fullscreenIcon;
+        const Icon& fullscreenButtonIcon = icons.get(isFullscreen ? unfullscreenIcon : fullscreenIcon);
         auto fullscreenButton = ui.textureButton(&uiRenderer, fullscreenButtonIcon, glm::vec2(32, 32), 4);
         
         if (fullscreenButton)
@@ -507,27 +884,142 @@ int main(int argc, char** argv)
       ui.end();
     }
 
+    // I toggles the statistics overlay
+    bool statsPressed = glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS;
+    if (statsPressed && !wasStatsKeyPressed)
+      statsOverlay.visible = !statsOverlay.visible;
+    wasStatsKeyPressed = statsPressed;
+
+    if (statsOverlay.visible)
+    {
+      double now = glfwGetTime();
+      VideoDecodeStats videoStats = current->video.GetDecodeStats();
+
+      if (now - statsWindowStart >= 0.5)
+      {
+        double elapsed = now - statsWindowStart;
+        // Counters restart with the item after a switch
+        playbackStats.decodeFps = videoStats.framesDecoded >= statsDecodedAtStart ?
+          (videoStats.framesDecoded - statsDecodedAtStart) / elapsed : 0.0;
+        playbackStats.presentFps = (framesPresented - statsPresentedAtStart) / elapsed;
+        playbackStats.driftMaxMs = windowDriftMax;
+
+        statsWindowStart = now;
+        statsDecodedAtStart = videoStats.framesDecoded;
+        statsPresentedAtStart = framesPresented;
+        windowDriftMax = 0.0;
+      }
+
+      AVFormatContext* formatCTX = current->source.GetFormatContext();
+      const char* pixelFormat = av_get_pix_fmt_name(current->video.GetOutputFormat());
+      playbackStats.width = frameWidth;
+      playbackStats.height = frameHeight;
+      playbackStats.codec = formatCTX ? avcodec_get_name(formatCTX->streams[current->source.GetVideoStreamIndex()]->codecpar->codec_id) : "";
+      playbackStats.pixelFormat = pixelFormat ? pixelFormat : "";
+      playbackStats.framesDropped = videoStats.framesDroppedLate;
+      playbackStats.framesSkipped = videoStats.framesSkipped;
+      playbackStats.framesDecimated = videoStats.framesDecimated;
+      playbackStats.skipLevel = videoStats.skipLevel;
+      playbackStats.framesQueued = current->video.GetQueuedFrames();
+      playbackStats.queueDepth = current->video.GetQueueDepth();
+      playbackStats.videoPackets = current->source.GetVideoQueue() ? current->source.GetVideoQueue()->Size() : 0;
+      playbackStats.audioPackets = current->source.GetAudioQueue() ? current->source.GetAudioQueue()->Size() : 0;
+      playbackStats.hasAudio = current->hasAudio;
+      playbackStats.audioBufferedMs = current->hasAudio ? 1000.0 * current->audio.GetBufferedSeconds() : 0.0;
+      playbackStats.uploadMs = videoRenderer.GetUploadMilliseconds();
+      playbackStats.gpuMs = videoRenderer.GetGpuMilliseconds();
+
+      statsOverlay.render(&uiRenderer, playbackStats, glm::vec2(16.0f, window_height - 16.0f));
+    }
+    uiRenderer.flush();
+
+    if (timingGpu)
+      videoRenderer.EndGpuTimer();
+
+    int64_t swapSpan = Telemetry::Begin();
     glfwSwapBuffers(window);
+    Telemetry::End("glfwSwapBuffers", swapSpan);
+
+    // Present jitter: wall time between consecutive frames against their media spacing,
+    // skipped across seeks and item switches
+    if (presentedTime >= 0.0)
+    {
+      double now = glfwGetTime();
+      double spacing = presentedTime - lastPresentTime;
+      if (lastPresentWall >= 0.0 && spacing > 0.0 && spacing < 4.0 * current->video.GetFrameDuration() * std::max(1.0, playbackRate))
+        Telemetry::Value("present jitter ms", 1000.0 * ((now - lastPresentWall) - spacing / playbackRate));
+
+      lastPresentWall = now;
+      lastPresentTime = presentedTime;
+      presentedTime = -1.0;
+    }
+
     glfwPollEvents();
+    Telemetry::End("frame", frameSpan);
+  }
+
+  next->Stop();
+  current->Stop();
+
+  VideoDecodeStats decodeStats = current->video.GetDecodeStats();
+  if (decodeStats.wallSeconds > 0.0)
+  {
+    const char* threadType = decodeStats.threadType == FF_THREAD_FRAME ? "frame" :
+                             decodeStats.threadType == FF_THREAD_SLICE ? "slice" : "none";
+    printf("Video decode: %d %s threads, %llu frames, worker busy %.0f%% (%.2f cores of CPU)\n",
+           decodeStats.threadCount,
+           threadType,
+           (unsigned long long)decodeStats.framesDecoded,
+           100.0 * decodeStats.decodeSeconds / decodeStats.wallSeconds,
+           decodeStats.workerCpuSeconds / decodeStats.wallSeconds);
+    if (decodeStats.codecThreads > 0)
+      printf("Codec threads: %d using %.2f cores of CPU, %.0f%% utilisation\n",
+             decodeStats.codecThreads,
+             decodeStats.codecCpuSeconds / decodeStats.wallSeconds,
+             100.0 * decodeStats.codecCpuSeconds / decodeStats.wallSeconds / decodeStats.codecThreads);
+    printf("Late frames: %llu dropped unshown, %llu shown without loop filter, %llu skipped undecoded, %d skip escalations\n",
+           (unsigned long long)decodeStats.framesDroppedLate,
+           (unsigned long long)decodeStats.framesDegraded,
+           (unsigned long long)decodeStats.framesSkipped,
+           decodeStats.skipEscalations);
+    if (decodeStats.framesDecimated > 0)
+      printf("Speed-up: %llu frames decoded but never shown at the playback rate\n", (unsigned long long)decodeStats.framesDecimated);
+  }
+  if (current->source.UsesReadAhead())
+  {
+    ReadAheadStats readStats = current->source.GetReadAheadStats();
+    printf("Read-ahead (%s, %lld MB window): %llu hits, %llu stalls, %llu misses, %.0f ms waiting, %llu MB read, %llu requests cancelled\n",
+           readStats.usingIoUring ? "io_uring" : "thread pool",
+           (long long)(readStats.windowBytes / (1024 * 1024)),
+           (unsigned long long)readStats.hits,
+           (unsigned long long)readStats.stalls,
+           (unsigned long long)readStats.misses,
+           1000.0 * readStats.stallSeconds,
+           (unsigned long long)(readStats.bytesRead / (1024 * 1024)),
+           (unsigned long long)readStats.cancelled);
+  }
+  if (itemSwitches > 0)
+  {
+    printf("Playlist: %d items switched, %d decoders reused\n",
+           itemSwitches, decodeStats.decodersReused + next->video.GetDecodeStats().decodersReused);
+  }
+  if (driftSamples > 0)
+  {
+    printf("A/V drift at presentation: mean %.1f ms, max %.1f ms over %llu frames\n",
+           1000.0 * driftSum / driftSamples, 1000.0 * driftMax, (unsigned long long)driftSamples);
   }
 
-  audioThreadRunning = false;
-  if (hasAudio && audioThread.joinable())
-    audioThread.join();
+  current->Close();
+  next->Close();
+  audioOutput.Close();
 
-  delete[] frameData;
-  video.Close();
-  if (hasAudio)
-    audio.Close();
+  if (Telemetry::IsEnabled())
+    Telemetry::PrintSummary();
+  if (tracePath)
+    Telemetry::WriteTrace(tracePath);
   
   uiRenderer.cleanup();
-  uiRenderer.deleteTexture(pauseIcon);
-  uiRenderer.deleteTexture(playIcon);
-  uiRenderer.deleteTexture(audioIcon);
-  uiRenderer.deleteTexture(muteIcon);
-  uiRenderer.deleteTexture(fullscreenIcon);
-  uiRenderer.deleteTexture(unfullscreenIcon);
-  uiRenderer.deleteTexture(loopIcon);
+  icons.cleanup();
 
   glfwDestroyWindow(window);
   glfwTerminate();